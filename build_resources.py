@@ -1,6 +1,68 @@
 import pygame
 import struct
 
+# Block compression matching the BC1/BC4 decoder in src/gl/swgl.c.
+# Both formats store a 4x4 block of texels in 8 bytes.
+
+def pack_565(color):
+    r, g, b = [min(max(c, 0), 255) for c in color]
+    return ((r * 31 + 127) // 255 << 11) | ((g * 63 + 127) // 255 << 5) | ((b * 31 + 127) // 255)
+
+def unpack_565(color):
+    return [(color >> 11) * 255 // 31, ((color >> 5) & 63) * 255 // 63, (color & 31) * 255 // 31]
+
+def encode_bc1_block(texels):
+    # texels is a list of 16 (r, g, b, a) tuples. Texels with alpha below 128 become transparent.
+    opaque = [t for t in texels if t[3] >= 128]
+    transparent = len(opaque) < 16
+
+    if opaque:
+        color0 = pack_565([max(t[c] for t in opaque) for c in range(3)])
+        color1 = pack_565([min(t[c] for t in opaque) for c in range(3)])
+    else:
+        color0 = color1 = 0
+
+    # color0 <= color1 selects three colors plus transparent black, color0 > color1 four colors
+    if (transparent and color0 > color1) or (not transparent and color0 < color1):
+        color0, color1 = color1, color0
+
+    c0 = unpack_565(color0)
+    c1 = unpack_565(color1)
+    if color0 > color1:
+        palette = [c0, c1, [(2 * a + b) / 3 for a, b in zip(c0, c1)], [(a + 2 * b) / 3 for a, b in zip(c0, c1)]]
+    else:
+        palette = [c0, c1, [(a + b) / 2 for a, b in zip(c0, c1)]]
+
+    indices = 0
+    for i, t in enumerate(texels):
+        if t[3] < 128 and transparent:
+            selector = 3
+        else:
+            selector = min(range(len(palette)), key=lambda s: sum((t[c] - palette[s][c]) ** 2 for c in range(3)))
+        indices |= selector << (i * 2)
+
+    return struct.pack("<HHI", color0, color1, indices)
+
+def encode_bc4_block(values):
+    # values is a list of 16 single channel values in 0..255
+    red0 = max(values)
+    red1 = min(values)
+    palette = [red0, red1] + [((8 - i) * red0 + (i - 1) * red1) / 7 for i in range(2, 8)]
+
+    indices = 0
+    for i, v in enumerate(values):
+        selector = min(range(8), key=lambda s: abs(v - palette[s]))
+        indices |= selector << (i * 3)
+
+    return struct.pack("<BB", red0, red1) + indices.to_bytes(6, "little")
+
+def surface_blocks(surface):
+    # 4x4 blocks in rows, edge texels repeat when the size isn't a multiple of 4
+    width, height = surface.get_width(), surface.get_height()
+    for by in range(0, height, 4):
+        for bx in range(0, width, 4):
+            yield [tuple(surface.get_at((min(bx + i % 4, width - 1), min(by + i // 4, height - 1)))) for i in range(16)]
+
 def main():
     # 1. Initialize pygame and font
     pygame.init()
@@ -19,11 +81,9 @@ def main():
             surface = font.render(bytes([letter]), True, (255, 255, 255))  # white text
             surface = pygame.transform.scale(surface, (80, 160))  # resize
 
-            # 3. Write pixel data to file
-            for y in range(surface.get_height()):
-                for x in range(surface.get_width()):
-                    r, g, b, a = surface.get_at((x, y))  # Get the RGBA values
-                    f.write(bytes([r, g, b, a]))  # Write as 4 8-bit integers
+            # 3. Write the glyph as BC1 blocks, 0.5 bytes per texel
+            for block in surface_blocks(surface):
+                f.write(encode_bc1_block(block))
 
     cursor_file = "images/cursor.png"  # Specify your cursor file path here
     cursor = pygame.image.load(cursor_file)
@@ -45,7 +45,13 @@ void App_GlTestProc(WindowDescriptor* Self)
 
 void App_GlTestDestruc(WindowDescriptor* Self)
 {
+    GlTestStorage* Storage = (GlTestStorage*)Self->Storage;
+
+    // The vertex buffer goes with the VAO, its name was already deleted at creation
+    glDeleteVertexArrays(1, &Storage->VAO);
+    glDeleteProgram(Storage->ShaderProgram);
 
+    free(Storage);
 }
 
 WindowDescriptor* App_GlTestNewWindow()
@@ -80,7 +86,7 @@ WindowDescriptor* App_GlTestNewWindow()
 
     glBindVertexArray(NewStorage->VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, NewStorage->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
     float Vertices[] = {
         -1.0f, -0.2f, 2.0f, 1.0f, 0.0f, 0.0f,
@@ -93,6 +99,9 @@ WindowDescriptor* App_GlTestNewWindow()
     glVertexAttribPointer(0, 3, GL_FLOAT, false, 6 * sizeof(float), (void*)0);
     glVertexAttribPointer(1, 3, GL_FLOAT, false, 6 * sizeof(float), (void*)(3 * sizeof(float)));
 
+    // The VAO keeps the buffer alive, deleting the name now means deleting the VAO frees it
+    glDeleteBuffers(1, &VBO);
+
     NewStorage->Tick = 0.0f;
 
     Window->Storage = NewStorage;
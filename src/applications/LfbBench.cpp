@@ -0,0 +1,152 @@
+#include "LfbBench.hpp"
+#include "../kernel.hpp"
+#include "../memory.hpp"
+#include "../render.hpp"
+#include "../drivers/bga/bga.hpp"
+#include "../utils/bench.hpp"
+
+#include <emmintrin.h>
+
+#define LFBBENCH_SIZE (256 * 1024)
+#define LFBBENCH_STRATEGIES 5
+#define LFBBENCH_TARGETS 2
+// Pages of video memory present can flip between, the block written goes after them
+#define LFBBENCH_PRESENT_PAGES 3
+
+static const char* App_LfbBenchStrategyNames[LFBBENCH_STRATEGIES] = { "byte    ", "dword   ", "movdqu  ", "movnti  ", "movntdq " };
+static const char* App_LfbBenchTargetNames[LFBBENCH_TARGETS] = { " lfb ", " ram " };
+
+struct LfbBenchStorage
+{
+    // 0 when there's no video memory past the present pages
+    uint8_t* Lfb;
+    uint8_t* Ram;
+    uint8_t* RamAlloc;
+    // Bytes written per 1000 cycles
+    uint32_t Bandwidth[LFBBENCH_STRATEGIES][LFBBENCH_TARGETS];
+    _String* Report;
+};
+
+extern Renderer Render;
+extern uint8_t PresentWriteCombining;
+
+// Fills LFBBENCH_SIZE bytes at Dst, which is 16 byte aligned, the way Strategy stores
+static void App_LfbBenchWrite(uint8_t* Dst, int Strategy)
+{
+    __m128i Value = _mm_set1_epi32(0x40404040);
+
+    switch (Strategy)
+    {
+    case 0:
+        for (int i = 0;i < LFBBENCH_SIZE;i++) ((volatile uint8_t*)Dst)[i] = 0x40;
+        break;
+    case 1:
+        for (int i = 0;i < LFBBENCH_SIZE / 4;i++) ((volatile uint32_t*)Dst)[i] = 0x40404040;
+        break;
+    case 2:
+        for (int i = 0;i < LFBBENCH_SIZE;i += 16) _mm_storeu_si128((__m128i*)(Dst + i), Value);
+        break;
+    case 3:
+        for (int i = 0;i < LFBBENCH_SIZE;i += 4) _mm_stream_si32((int*)(Dst + i), 0x40404040);
+        break;
+    case 4:
+        for (int i = 0;i < LFBBENCH_SIZE;i += 16) _mm_stream_si128((__m128i*)(Dst + i), Value);
+        break;
+    }
+
+    // Part of the timing, the stores have to have left the write-combining buffers
+    _mm_sfence();
+}
+
+void App_LfbBenchProc(WindowDescriptor* Self)
+{
+    LfbBenchStorage* Storage = (LfbBenchStorage*)Self->Storage;
+    uint8_t* Targets[LFBBENCH_TARGETS] = { Storage->Lfb, Storage->Ram };
+
+    for (int Strategy = 0;Strategy < LFBBENCH_STRATEGIES;Strategy++)
+    {
+        for (int Target = 0;Target < LFBBENCH_TARGETS;Target++)
+        {
+            if (!Targets[Target]) continue;
+
+            uint64_t Start = BenchTimestamp();
+            App_LfbBenchWrite(Targets[Target], Strategy);
+            uint32_t Cycles = (uint32_t)(BenchTimestamp() - Start);
+
+            Storage->Bandwidth[Strategy][Target] = Cycles ? (uint32_t)LFBBENCH_SIZE * 1000 / Cycles : 0;
+        }
+    }
+
+    Storage->Report->Size = 0;
+
+    BenchAppendText(Storage->Report, PresentWriteCombining ? "lfb write-combining\n" : "lfb not write-combining\n");
+    if (!Storage->Lfb) BenchAppendText(Storage->Report, "no spare video memory\n");
+    BenchAppendText(Storage->Report, "bytes per 1000 cycles\n");
+
+    for (int Strategy = 0;Strategy < LFBBENCH_STRATEGIES;Strategy++)
+    {
+        BenchAppendText(Storage->Report, App_LfbBenchStrategyNames[Strategy]);
+
+        for (int Target = 0;Target < LFBBENCH_TARGETS;Target++)
+        {
+            if (!Targets[Target]) continue;
+            BenchAppendText(Storage->Report, App_LfbBenchTargetNames[Target]);
+            BenchAppendNumber(Storage->Report, Storage->Bandwidth[Strategy][Target], 0);
+        }
+
+        StringPush(Storage->Report, '\n');
+    }
+
+    Render.DrawText(Storage->Report, Self->X + 10, Self->Y + 20, 14, 1.0f, 1.0f, 0.0f, 1.0f);
+}
+
+void App_LfbBenchDestruc(WindowDescriptor* Self)
+{
+    LfbBenchStorage* Storage = (LfbBenchStorage*)Self->Storage;
+
+    free(Storage->RamAlloc);
+    free(Storage->Report->Data);
+    free(Storage->Report);
+    free(Storage);
+}
+
+WindowDescriptor* App_LfbBenchNewWindow()
+{
+    WindowDescriptor* Window = (WindowDescriptor*)malloc(sizeof(WindowDescriptor));
+    Window->X = 0;
+    Window->Y = 0;
+    Window->Width = 400;
+    Window->Height = 200;
+    Window->EventCounter = 0;
+
+    LfbBenchStorage* NewStorage = (LfbBenchStorage*)malloc(sizeof(LfbBenchStorage));
+
+    // Writing the screen or a page present flips to would show, only memory past all of them is free to use
+    uint32_t PageBytes = VbeModeInfo.pitch * VbeModeInfo.height;
+    uint32_t VideoMemory = BGA_IsAvailable() ? BGA_GetVideoMemory() : 0;
+    uint32_t Offset = (LFBBENCH_PRESENT_PAGES * PageBytes + 15) & ~15;
+
+    NewStorage->Lfb = 0;
+    if (Offset + LFBBENCH_SIZE <= VideoMemory) NewStorage->Lfb = (uint8_t*)VbeModeInfo.framebuffer + Offset;
+
+    NewStorage->RamAlloc = (uint8_t*)malloc(LFBBENCH_SIZE + 16);
+    NewStorage->Ram = (uint8_t*)(((uint32_t)NewStorage->RamAlloc + 15) & ~15);
+
+    for (int Strategy = 0;Strategy < LFBBENCH_STRATEGIES;Strategy++)
+    {
+        for (int Target = 0;Target < LFBBENCH_TARGETS;Target++)
+        {
+            NewStorage->Bandwidth[Strategy][Target] = 0;
+        }
+    }
+
+    NewStorage->Report = NewString();
+
+    Window->Storage = NewStorage;
+
+    Window->Name = CString2String("LfbBench");
+    Window->WinProc = &App_LfbBenchProc;
+    Window->WinDestruc = &App_LfbBenchDestruc;
+
+    return Window;
+}
@@ -0,0 +1,10 @@
+#ifndef H_TOS_APP_LFBBENCH
+#define H_TOS_APP_LFBBENCH
+
+#include "../windowing.hpp"
+
+// Times writing a block of off screen video memory and a block of RAM with each store instruction
+// present could use, and shows the bandwidths in the window.
+WindowDescriptor* App_LfbBenchNewWindow();
+
+#endif // H_TOS_APP_LFBBENCH
@@ -0,0 +1,152 @@
+#include "MemBench.hpp"
+#include "../memory.hpp"
+#include "../render.hpp"
+#include "../strops.hpp"
+#include "../utils/bench.hpp"
+
+#define MEMBENCH_SIZES 9
+#define MEMBENCH_MAX_SIZE (1024 * 1024)
+// Small sizes are repeated until at least this many bytes were moved, so the timing isn't only rdtsc
+#define MEMBENCH_MIN_BYTES (256 * 1024)
+#define MEMBENCH_COPIES 6
+#define MEMBENCH_SETS 6
+#define MEMBENCH_COLUMN 6
+
+static const uint32_t App_MemBenchSizes[MEMBENCH_SIZES] = { 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576 };
+static const char* App_MemBenchSizeNames[MEMBENCH_SIZES] = { "16", "64", "256", "1k", "4k", "16k", "64k", "256k", "1m" };
+
+static void App_MemBenchMemcpy(void* Dst, const void* Src, size_t N)
+{
+    memcpy(Dst, Src, N);
+}
+
+static void App_MemBenchMemset(void* Dst, uint8_t Val, size_t N)
+{
+    memset(Dst, Val, N);
+}
+
+static const StrOps_CopyProc App_MemBenchCopies[MEMBENCH_COPIES] = { &StrOps_CopyBytes, &StrOps_CopyRepMovsd, &StrOps_CopyRepMovsb, &StrOps_CopySse2, &StrOps_CopyStream, &App_MemBenchMemcpy };
+static const char* App_MemBenchCopyNames[MEMBENCH_COPIES] = { "cpy byte   ", "cpy movsd  ", "cpy movsb  ", "cpy sse2   ", "cpy movntdq", "memcpy     " };
+static const StrOps_SetProc App_MemBenchSets[MEMBENCH_SETS] = { &StrOps_SetBytes, &StrOps_SetRepStosd, &StrOps_SetRepStosb, &StrOps_SetSse2, &StrOps_SetStream, &App_MemBenchMemset };
+static const char* App_MemBenchSetNames[MEMBENCH_SETS] = { "set byte   ", "set stosd  ", "set stosb  ", "set sse2   ", "set movntdq", "memset     " };
+
+struct MemBenchStorage
+{
+    uint8_t* Src;
+    uint8_t* Dst;
+    uint8_t* SrcAlloc;
+    uint8_t* DstAlloc;
+    // Bytes moved per 1000 cycles
+    uint32_t CopyBandwidth[MEMBENCH_COPIES][MEMBENCH_SIZES];
+    uint32_t SetBandwidth[MEMBENCH_SETS][MEMBENCH_SIZES];
+    _String* Report;
+};
+
+extern Renderer Render;
+
+// Right aligned in a MEMBENCH_COLUMN wide column
+static void App_MemBenchAppendColumn(_String* Str, const char* Text)
+{
+    int Length = strlen(Text);
+    for (int i = Length;i < MEMBENCH_COLUMN;i++) StringPush(Str, ' ');
+    BenchAppendText(Str, Text);
+}
+
+static uint32_t App_MemBenchBandwidth(uint32_t Bytes, uint32_t Cycles)
+{
+    return Cycles ? Bytes * 1000 / Cycles : 0;
+}
+
+void App_MemBenchProc(WindowDescriptor* Self)
+{
+    MemBenchStorage* Storage = (MemBenchStorage*)Self->Storage;
+
+    for (int Size = 0;Size < MEMBENCH_SIZES;Size++)
+    {
+        uint32_t Bytes = App_MemBenchSizes[Size];
+        uint32_t Repeats = Bytes < MEMBENCH_MIN_BYTES ? MEMBENCH_MIN_BYTES / Bytes : 1;
+
+        for (int Copy = 0;Copy < MEMBENCH_COPIES;Copy++)
+        {
+            uint32_t Start = (uint32_t)BenchTimestamp(); // Only differences are used, they fit in 32 bits
+            for (uint32_t i = 0;i < Repeats;i++) App_MemBenchCopies[Copy](Storage->Dst, Storage->Src, Bytes);
+            Storage->CopyBandwidth[Copy][Size] = App_MemBenchBandwidth(Bytes * Repeats, (uint32_t)BenchTimestamp() - Start);
+        }
+
+        for (int Set = 0;Set < MEMBENCH_SETS;Set++)
+        {
+            uint32_t Start = (uint32_t)BenchTimestamp();
+            for (uint32_t i = 0;i < Repeats;i++) App_MemBenchSets[Set](Storage->Dst, 0x40, Bytes);
+            Storage->SetBandwidth[Set][Size] = App_MemBenchBandwidth(Bytes * Repeats, (uint32_t)BenchTimestamp() - Start);
+        }
+    }
+
+    Storage->Report->Size = 0;
+
+    BenchAppendText(Storage->Report, StrOps_Erms ? "erms, " : "no erms, ");
+    BenchAppendText(Storage->Report, "bytes per 1000 cycles\n           ");
+    for (int Size = 0;Size < MEMBENCH_SIZES;Size++) App_MemBenchAppendColumn(Storage->Report, App_MemBenchSizeNames[Size]);
+    StringPush(Storage->Report, '\n');
+
+    for (int Copy = 0;Copy < MEMBENCH_COPIES;Copy++)
+    {
+        BenchAppendText(Storage->Report, App_MemBenchCopyNames[Copy]);
+        for (int Size = 0;Size < MEMBENCH_SIZES;Size++) BenchAppendNumber(Storage->Report, Storage->CopyBandwidth[Copy][Size], MEMBENCH_COLUMN);
+        StringPush(Storage->Report, '\n');
+    }
+
+    for (int Set = 0;Set < MEMBENCH_SETS;Set++)
+    {
+        BenchAppendText(Storage->Report, App_MemBenchSetNames[Set]);
+        for (int Size = 0;Size < MEMBENCH_SIZES;Size++) BenchAppendNumber(Storage->Report, Storage->SetBandwidth[Set][Size], MEMBENCH_COLUMN);
+        StringPush(Storage->Report, '\n');
+    }
+
+    Render.DrawText(Storage->Report, Self->X + 10, Self->Y + 20, 12, 1.0f, 1.0f, 0.0f, 1.0f);
+}
+
+void App_MemBenchDestruc(WindowDescriptor* Self)
+{
+    MemBenchStorage* Storage = (MemBenchStorage*)Self->Storage;
+
+    free(Storage->SrcAlloc);
+    free(Storage->DstAlloc);
+    free(Storage->Report->Data);
+    free(Storage->Report);
+    free(Storage);
+}
+
+WindowDescriptor* App_MemBenchNewWindow()
+{
+    WindowDescriptor* Window = (WindowDescriptor*)malloc(sizeof(WindowDescriptor));
+    Window->X = 0;
+    Window->Y = 0;
+    Window->Width = 600;
+    Window->Height = 240;
+    Window->EventCounter = 0;
+
+    MemBenchStorage* NewStorage = (MemBenchStorage*)malloc(sizeof(MemBenchStorage));
+
+    NewStorage->SrcAlloc = (uint8_t*)malloc(MEMBENCH_MAX_SIZE + 16);
+    NewStorage->DstAlloc = (uint8_t*)malloc(MEMBENCH_MAX_SIZE + 16);
+    NewStorage->Src = (uint8_t*)(((uint32_t)NewStorage->SrcAlloc + 15) & ~15);
+    NewStorage->Dst = (uint8_t*)(((uint32_t)NewStorage->DstAlloc + 15) & ~15);
+
+    memset(NewStorage->Src, 0x20, MEMBENCH_MAX_SIZE);
+
+    for (int Size = 0;Size < MEMBENCH_SIZES;Size++)
+    {
+        for (int Copy = 0;Copy < MEMBENCH_COPIES;Copy++) NewStorage->CopyBandwidth[Copy][Size] = 0;
+        for (int Set = 0;Set < MEMBENCH_SETS;Set++) NewStorage->SetBandwidth[Set][Size] = 0;
+    }
+
+    NewStorage->Report = NewString();
+
+    Window->Storage = NewStorage;
+
+    Window->Name = CString2String("MemBench");
+    Window->WinProc = &App_MemBenchProc;
+    Window->WinDestruc = &App_MemBenchDestruc;
+
+    return Window;
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#ifndef H_TOS_APP_MEMBENCH
+#define H_TOS_APP_MEMBENCH
+
+#include "../windowing.hpp"
+
+// Times each copy and fill strategy of strops, and memcpy and memset picking between them, over a range of
+// sizes and shows the bandwidths in the window, one row per strategy and one column per size.
+WindowDescriptor* App_MemBenchNewWindow();
+
+#endif // H_TOS_APP_MEMBENCH
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include "TexBench.hpp"
+#include "../gl/swgl.h"
+#include "../memory.hpp"
+#include "../render.hpp"
+#include "../utils/bench.hpp"
+
+const char* App_TexBenchVertShaderSource = "layout(location = 0) vec3 InPos;layout(location = 1) vec2 InUV;out vec2 UV;int main(){gl_Position = vec4(InPos.x, InPos.y, InPos.z, 1.0);UV = InUV;}";
+const char* App_TexBenchFragShaderSource = "out vec4 OutColor;in vec2 UV;uniform sampler2D Tex;int main(){OutColor = texture(Tex, UV);}";
+
+#define TEXBENCH_SIZE 512
+#define TEXBENCH_LAYOUTS 3
+#define TEXBENCH_WALKS 3
+
+static const GLenum App_TexBenchLayouts[TEXBENCH_LAYOUTS] = { GL_TEXTURE_LAYOUT_LINEAR, GL_TEXTURE_LAYOUT_TILED_4X4, GL_TEXTURE_LAYOUT_TILED_8X8 };
+static const char* App_TexBenchLayoutNames[TEXBENCH_LAYOUTS] = { "linear  ", "tiled4x4", "tiled8x8" };
+static const char* App_TexBenchWalkNames[TEXBENCH_WALKS] = { " H ", " V ", " D " };
+
+struct TexBenchStorage
+{
+    GLuint ShaderProgram;
+    GLint SamplerLoc;
+    // One quad per walk direction, the UVs are rotated so consecutive pixels in a scanline
+    // step along U, along V or along both
+    GLuint WalkVAO[TEXBENCH_WALKS];
+    GLuint Textures[TEXBENCH_LAYOUTS];
+    uint32_t Cycles[TEXBENCH_LAYOUTS][TEXBENCH_WALKS];
+    _String* Report;
+};
+
+extern Renderer Render;
+
+void App_TexBenchProc(WindowDescriptor* Self)
+{
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    TexBenchStorage* Storage = (TexBenchStorage*)Self->Storage;
+
+    glUseProgram(Storage->ShaderProgram);
+    glUniform1i(Storage->SamplerLoc, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    for (int Layout = 0;Layout < TEXBENCH_LAYOUTS;Layout++)
+    {
+        glBindTexture(GL_TEXTURE_2D, Storage->Textures[Layout]);
+
+        for (int Walk = 0;Walk < TEXBENCH_WALKS;Walk++)
+        {
+            glBindVertexArray(Storage->WalkVAO[Walk]);
+
+            uint64_t Start = BenchTimestamp();
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            Storage->Cycles[Layout][Walk] = (uint32_t)(BenchTimestamp() - Start) / 1000;
+        }
+    }
+
+    Storage->Report->Size = 0;
+
+    for (int Layout = 0;Layout < TEXBENCH_LAYOUTS;Layout++)
+    {
+        BenchAppendText(Storage->Report, App_TexBenchLayoutNames[Layout]);
+
+        for (int Walk = 0;Walk < TEXBENCH_WALKS;Walk++)
+        {
+            BenchAppendText(Storage->Report, App_TexBenchWalkNames[Walk]);
+            BenchAppendNumber(Storage->Report, Storage->Cycles[Layout][Walk], 0);
+            StringPush(Storage->Report, 'k');
+        }
+
+        StringPush(Storage->Report, '\n');
+    }
+
+    Render.DrawText(Storage->Report, Self->X + 10, Self->Y + 20, 14, 1.0f, 1.0f, 0.0f, 1.0f);
+}
+
+void App_TexBenchDestruc(WindowDescriptor* Self)
+{
+    TexBenchStorage* Storage = (TexBenchStorage*)Self->Storage;
+
+    // The vertex buffers go with the VAOs, their names were already deleted at creation
+    glDeleteVertexArrays(TEXBENCH_WALKS, Storage->WalkVAO);
+    glDeleteTextures(TEXBENCH_LAYOUTS, Storage->Textures);
+    glDeleteProgram(Storage->ShaderProgram);
+
+    free(Storage->Report->Data);
+    free(Storage->Report);
+    free(Storage);
+}
+
+WindowDescriptor* App_TexBenchNewWindow()
+{
+    WindowDescriptor* Window = (WindowDescriptor*)malloc(sizeof(WindowDescriptor));
+    Window->X = 0;
+    Window->Y = 0;
+    Window->Width = 400;
+    Window->Height = 200;
+    Window->EventCounter = 0;
+
+    TexBenchStorage* NewStorage = (TexBenchStorage*)malloc(sizeof(TexBenchStorage));
+
+    GLuint VertShader = glCreateShader(GL_VERTEX_SHADER);
+    GLuint FragShader = glCreateShader(GL_FRAGMENT_SHADER);
+
+    glShaderSource(VertShader, App_TexBenchVertShaderSource);
+    glShaderSource(FragShader, App_TexBenchFragShaderSource);
+
+    glCompileShader(VertShader);
+    glCompileShader(FragShader);
+
+    NewStorage->ShaderProgram = glCreateProgram();
+    glAttachShader(NewStorage->ShaderProgram, VertShader);
+    glAttachShader(NewStorage->ShaderProgram, FragShader);
+
+    glLinkProgram(NewStorage->ShaderProgram);
+
+    NewStorage->SamplerLoc = glGetUniformLocation(NewStorage->ShaderProgram, "Tex");
+
+    // The window is far smaller than the texture, so every draw minifies it like the
+    // glyphs in the cmd window and each pixel lands several texels from the last one.
+    // No mip chain is generated so all draws sample level 0.
+    float Walks[TEXBENCH_WALKS][30] = {
+        {
+            -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+            1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
+            1.0f, -1.0f, 0.0f, 1.0f, 1.0f,
+            -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+            -1.0f, -1.0f, 0.0f, 0.0f, 1.0f,
+            1.0f, -1.0f, 0.0f, 1.0f, 1.0f
+        },
+        {
+            -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+            1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+            1.0f, -1.0f, 0.0f, 1.0f, 1.0f,
+            -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+            -1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
+            1.0f, -1.0f, 0.0f, 1.0f, 1.0f
+        },
+        {
+            -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+            1.0f, 1.0f, 0.0f, 1.0f, 1.0f,
+            1.0f, -1.0f, 0.0f, 2.0f, 0.0f,
+            -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+            -1.0f, -1.0f, 0.0f, 1.0f, -1.0f,
+            1.0f, -1.0f, 0.0f, 2.0f, 0.0f
+        }
+    };
+
+    for (int Walk = 0;Walk < TEXBENCH_WALKS;Walk++)
+    {
+        GLuint VBO;
+        glGenVertexArrays(1, &NewStorage->WalkVAO[Walk]);
+        glGenBuffers(1, &VBO);
+
+        glBindVertexArray(NewStorage->WalkVAO[Walk]);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Walks[Walk]), Walks[Walk], GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+
+        glDeleteBuffers(1, &VBO);
+    }
+
+    uint8_t* Pixels = (uint8_t*)malloc(TEXBENCH_SIZE * TEXBENCH_SIZE * 4);
+    for (int i = 0;i < TEXBENCH_SIZE * TEXBENCH_SIZE;i++)
+    {
+        int X = i % TEXBENCH_SIZE;
+        int Y = i / TEXBENCH_SIZE;
+        Pixels[i * 4 + 0] = X;
+        Pixels[i * 4 + 1] = Y;
+        Pixels[i * 4 + 2] = ((X / 32) ^ (Y / 32)) & 1 ? 255 : 0;
+        Pixels[i * 4 + 3] = 255;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    for (int Layout = 0;Layout < TEXBENCH_LAYOUTS;Layout++)
+    {
+        glGenTextures(1, &NewStorage->Textures[Layout]);
+        glBindTexture(GL_TEXTURE_2D, NewStorage->Textures[Layout]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_LAYOUT, App_TexBenchLayouts[Layout]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TEXBENCH_SIZE, TEXBENCH_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, Pixels);
+    }
+
+    free(Pixels);
+
+    for (int Layout = 0;Layout < TEXBENCH_LAYOUTS;Layout++)
+    {
+        for (int Walk = 0;Walk < TEXBENCH_WALKS;Walk++)
+        {
+            NewStorage->Cycles[Layout][Walk] = 0;
+        }
+    }
+
+    NewStorage->Report = NewString();
+
+    Window->Storage = NewStorage;
+
+    Window->Name = CString2String("TexBench");
+    Window->WinProc = &App_TexBenchProc;
+    Window->WinDestruc = &App_TexBenchDestruc;
+
+    return Window;
+}
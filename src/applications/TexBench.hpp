@@ -0,0 +1,10 @@
+#ifndef H_TOS_APP_TEXBENCH
+#define H_TOS_APP_TEXBENCH
+
+#include "../windowing.hpp"
+
+// Times textured draws that walk a texture horizontally, vertically and diagonally
+// for each texel layout swgl supports, and shows the cycle counts in the window.
+WindowDescriptor* App_TexBenchNewWindow();
+
+#endif // H_TOS_APP_TEXBENCH
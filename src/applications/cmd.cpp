@@ -38,8 +38,10 @@ void App_CmdProc(WindowDescriptor* Self)
         }
     }
 
-    int X = Self->X + 20;
-    int Y = Self->Y + 20;
+    int X = Self->X + 10;
+
+    // Text with the line wraps applied, rebuilt every frame and drawn with one DrawText call
+    _String* Layout = NewArenaString(FrameArena);
 
     for (int i = 0;i < Storage->Text->Size;i++)
     {
@@ -48,22 +50,23 @@ void App_CmdProc(WindowDescriptor* Self)
         {
         case '\n':
             X = Self->X + 10;
-            Y += 25;
             break;
         case '\t':
             X += 40;
             break;
         default:
-            Render.DrawLetter(C, X, Y, 10, 20, 1.0f, 1.0f, 1.0f, 1.0f);
             X += 10;
             break;
         }
+        StringPush(Layout, C);
         if (X + 20 > Self->X + Self->Width)
         {
             X = Self->X + 10;
-            Y += 25;
+            StringPush(Layout, '\n');
         }
     }
+
+    Render.DrawText(Layout, Self->X + 10, Self->Y + 20, 20, 1.0f, 1.0f, 1.0f, 1.0f);
 }
 
 void App_CmdDestruc(WindowDescriptor* Self)
@@ -35,30 +35,24 @@ read_ata:
 
     or al, 0b11100000
     or al, dl
-    mov edx, ebx
-    add edx, 6
+    lea edx, [ebx + 6]
     out dx, al
 
-    mov edx, ebx
-    add edx, 2
+    lea edx, [ebx + 2]
     mov al, 1
     out dx, al
     mov eax, ecx
-    mov edx, ebx
-    add edx, 3
+    lea edx, [ebx + 3]
     out dx, al
     mov eax, ecx
     shr eax, 8
-    mov edx, ebx
-    add edx, 4
+    lea edx, [ebx + 4]
     out dx, al
     mov eax, ecx
     shr eax, 16
-    mov edx, ebx
-    add edx, 5
+    lea edx, [ebx + 5]
     out dx, al
-    mov edx, ebx
-    add edx, 7
+    lea edx, [ebx + 7]
     mov al, 0x20 ; Read with retry
     out dx, al
 .wait_drq_set:
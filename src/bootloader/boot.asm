@@ -9,8 +9,7 @@ Boot:
     xor ax, ax
     mov ss, ax
     mov ds, ax
-    mov ax, 0x7C00
-    mov sp, ax
+    mov sp, 0x7C00
 
     ; NOTE: SETUP VBE
     jmp SetupVbe
@@ -18,6 +17,25 @@ Boot:
 SetupVbe:
     call VesaVbeSetup
 
+    ; NOTE: Collect the BIOS memory map, only possible before the switch
+    ;       to protected mode. E820End is left past the last entry, at most
+    ;       E820_MAX_ENTRIES are kept.
+    xor ebx, ebx
+    mov di, E820Map
+.E820Next:
+    mov eax, 0xE820
+    mov ecx, 24
+    mov edx, 0x534D4150 ; 'SMAP'
+    int 0x15
+    jc .E820Done
+    add di, 24
+    cmp di, E820Map + E820_MAX_ENTRIES * 24
+    jae .E820Done
+    test ebx, ebx
+    jnz .E820Next
+.E820Done:
+    mov [E820End], di
+
     ; NOTE: Activate A20
     mov   ax, 0x2403
     int   0x15
@@ -77,8 +95,7 @@ After:
     or ax, 0x600      ; Set CR4.OSFXSR and CR4.OSXMMEXCPT (bits 9 and 10)
     mov cr4, eax
 
-    mov eax, unkernel_end
-    mov esp, eax
+    mov esp, unkernel_end
 
     mov edi, unkernel_end
     mov ecx, 32
@@ -113,6 +130,7 @@ times 510-($-$$) db 0
 dw 0xAA55
 
 %include "src/bootloader/vesa_vbe_setup_vars.asm"
+%include "src/bootloader/memory_map_vars.asm"
 
 times (16384-($-$$)) db 0
 unkernel_end:
@@ -139,4 +157,5 @@ ImageLabel:
 incbin "bin/images.bin"
 
 section .end
+global OsEnd
 OsEnd:
@@ -0,0 +1,11 @@
+; BIOS E820 memory map, filled in before the switch to protected mode.
+; Entries are 24 bytes: base (qword), length (qword), type (dword), ACPI attributes (dword).
+; The loop filling it stops once the buffer is full, no BIOS reports anywhere near that many.
+E820_MAX_ENTRIES equ 128
+
+global E820End
+global E820Map
+E820End: dw 0
+align 4
+E820Map:
+    times (E820_MAX_ENTRIES * 24) db 0
\ No newline at end of file
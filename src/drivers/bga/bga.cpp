@@ -0,0 +1,78 @@
+#include "../../io.hpp"
+#include "bga.hpp"
+
+#define BGA_PCI_VENDOR 0x1234
+#define BGA_PCI_DEVICE 0x1111
+
+uint16_t BGA_Read(uint16_t Index)
+{
+    IO_Out16(BGA_INDEX_PORT, Index);
+    return IO_In16(BGA_DATA_PORT);
+}
+
+void BGA_Write(uint16_t Index, uint16_t Value)
+{
+    IO_Out16(BGA_INDEX_PORT, Index);
+    IO_Out16(BGA_DATA_PORT, Value);
+}
+
+uint8_t BGA_IsAvailable()
+{
+    // 0xB0C0 to 0xB0C5 are the versions out there, the rest of 0xB0Cx is left for newer ones
+    uint16_t Id = BGA_Read(BGA_INDEX_ID);
+    return Id >= 0xB0C0 && Id <= 0xB0CF;
+}
+
+uint8_t BGA_SetMode(uint16_t Width, uint16_t Height, uint16_t Bpp)
+{
+    if (!BGA_IsAvailable()) return 0;
+
+    // The mode registers only take while the adapter is disabled
+    BGA_Write(BGA_INDEX_ENABLE, BGA_DISABLED);
+    BGA_Write(BGA_INDEX_XRES, Width);
+    BGA_Write(BGA_INDEX_YRES, Height);
+    BGA_Write(BGA_INDEX_BPP, Bpp);
+    BGA_Write(BGA_INDEX_ENABLE, BGA_ENABLED | BGA_LFB_ENABLED);
+
+    // Enabling works out the virtual height from the virtual width and the video memory
+    BGA_Write(BGA_INDEX_VIRT_WIDTH, Width);
+    BGA_Write(BGA_INDEX_X_OFFSET, 0);
+    BGA_Write(BGA_INDEX_Y_OFFSET, 0);
+
+    return BGA_Read(BGA_INDEX_XRES) == Width && BGA_Read(BGA_INDEX_YRES) == Height && BGA_Read(BGA_INDEX_BPP) == Bpp;
+}
+
+uint16_t BGA_GetVirtualHeight()
+{
+    return BGA_Read(BGA_INDEX_VIRT_HEIGHT);
+}
+
+void BGA_SetYOffset(uint16_t Y)
+{
+    BGA_Write(BGA_INDEX_Y_OFFSET, Y);
+}
+
+uint32_t BGA_GetVideoMemory()
+{
+    // Added with version 0xB0C5, older ones return what's on the bus
+    if (BGA_Read(BGA_INDEX_ID) < 0xB0C5) return 0;
+    return (uint32_t)BGA_Read(BGA_INDEX_VIDEO_MEMORY_64K) * 65536;
+}
+
+static uint32_t BGA_PciRead(uint8_t Device, uint8_t Offset)
+{
+    IO_Out32(0xCF8, 0x80000000 | ((uint32_t)Device << 11) | (Offset & 0xFC));
+    return IO_In32(0xCFC);
+}
+
+uint32_t BGA_GetFramebuffer()
+{
+    for (uint8_t Device = 0;Device < 32;Device++)
+    {
+        uint32_t Id = BGA_PciRead(Device, 0x00);
+        if ((Id & 0xFFFF) != BGA_PCI_VENDOR || (Id >> 16) != BGA_PCI_DEVICE) continue;
+
+        return BGA_PciRead(Device, 0x10) & 0xFFFFFFF0;
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef H_TOS_BGA
+#define H_TOS_BGA
+#include "../../io.hpp"
+
+// Bochs Graphics Adapter, the dispi registers of Bochs and QEMU's stdvga
+#define BGA_INDEX_PORT 0x1CE
+#define BGA_DATA_PORT  0x1CF
+
+#define BGA_INDEX_ID          0x0
+#define BGA_INDEX_XRES        0x1
+#define BGA_INDEX_YRES        0x2
+#define BGA_INDEX_BPP         0x3
+#define BGA_INDEX_ENABLE      0x4
+#define BGA_INDEX_BANK        0x5
+#define BGA_INDEX_VIRT_WIDTH  0x6
+#define BGA_INDEX_VIRT_HEIGHT 0x7
+#define BGA_INDEX_X_OFFSET    0x8
+#define BGA_INDEX_Y_OFFSET    0x9
+#define BGA_INDEX_VIDEO_MEMORY_64K 0xA
+
+#define BGA_DISABLED    0x00
+#define BGA_ENABLED     0x01
+#define BGA_LFB_ENABLED 0x40
+
+uint16_t BGA_Read(uint16_t Index);
+void BGA_Write(uint16_t Index, uint16_t Value);
+
+uint8_t BGA_IsAvailable();
+
+// Switches to Width x Height at Bpp bits per pixel with a linear framebuffer, 0 if the adapter refused.
+// The virtual screen is as wide as the mode and as tall as video memory allows.
+uint8_t BGA_SetMode(uint16_t Width, uint16_t Height, uint16_t Bpp);
+
+// Rows of the virtual screen, BGA_SetYOffset pans the visible window down it
+uint16_t BGA_GetVirtualHeight();
+void BGA_SetYOffset(uint16_t Y);
+
+// Bytes of video memory, 0 on adapters too old to report it
+uint32_t BGA_GetVideoMemory();
+
+// Physical address of the LFB from the adapter's PCI BAR 0, 0 if the adapter isn't found on bus 0
+uint32_t BGA_GetFramebuffer();
+
+#endif // H_TOS_BGA
@@ -3,6 +3,9 @@
 // Comment this line out for freestanding, you'll have to include your header files though that should allow malloc, memcpy, memset, and free.
 #include "../memory.hpp"
 
+#include <xmmintrin.h>
+#include <smmintrin.h>
+
 /*
 * HELPER CONSTANTS
 */
@@ -109,6 +112,7 @@ float swgl_tan(float x)
 
 #include "../utils/string.hpp"
 #include "../utils/vector.hpp"
+#include "../utils/arena.hpp"
 
 typedef struct
 {
@@ -116,6 +120,104 @@ typedef struct
 	int second;
 } _IntPair;
 
+/*
+* GL object names are handles into a HandleTable: the slot index + 1 in the low 16 bits and the slot's generation
+* in the high 16. Deleting an object bumps its slot's generation and puts the slot on the free list, so a stale
+* name never reaches the object that reuses the slot. Name 0 is never handed out.
+*/
+typedef struct
+{
+	void* Object; // 0 while the slot is free
+	uint16_t Generation;
+	int NextFree;
+} HandleSlot;
+
+typedef struct
+{
+	_Vector Slots; // Of type HandleSlot
+	int FreeHead; // -1 when every slot is in use
+} HandleTable;
+
+// Define SWGL_DEBUG to stop the CPU when a deleted or never generated name is used, with the name in eax
+#ifdef SWGL_DEBUG
+#define SWGL_STALE_HANDLE(Handle) asm volatile ("cli\nhlt\n" :: "a"(Handle))
+#else
+#define SWGL_STALE_HANDLE(Handle)
+#endif
+
+HandleTable NewHandleTable()
+{
+	HandleTable Table;
+	Table.Slots = NewVector(sizeof(HandleSlot));
+	Table.FreeHead = -1;
+	return Table;
+}
+
+uint32_t HandleAlloc(HandleTable* Table, void* Object)
+{
+	int Index = Table->FreeHead;
+	if (Index == -1)
+	{
+		HandleSlot Slot = { 0, 0, -1 };
+		VectorPushBack(&Table->Slots, &Slot);
+		Index = Table->Slots.Size - 1;
+	}
+
+	HandleSlot* Slot = (HandleSlot*)Table->Slots.Data + Index;
+	Table->FreeHead = Slot->NextFree;
+	Slot->Object = Object;
+	Slot->NextFree = -1;
+
+	return ((uint32_t)Slot->Generation << 16) | (Index + 1);
+}
+
+// Object in a slot, generation not checked. For walking every live object of a table.
+void* HandleSlotObject(HandleTable* Table, int Index)
+{
+	if (Index < 0 || Index >= Table->Slots.Size) return 0;
+	return ((HandleSlot*)Table->Slots.Data)[Index].Object;
+}
+
+int HandleIndex(uint32_t Handle)
+{
+	return (int)(Handle & 0xFFFF) - 1;
+}
+
+void* HandleLookup(HandleTable* Table, uint32_t Handle)
+{
+	int Index = HandleIndex(Handle);
+	if (Index < 0 || Index >= Table->Slots.Size)
+	{
+		SWGL_STALE_HANDLE(Handle);
+		return 0;
+	}
+
+	HandleSlot* Slot = (HandleSlot*)Table->Slots.Data + Index;
+	if (!Slot->Object || Slot->Generation != (uint16_t)(Handle >> 16))
+	{
+		SWGL_STALE_HANDLE(Handle);
+		return 0;
+	}
+
+	return Slot->Object;
+}
+
+// Frees the slot and returns the object it held so the caller can release it, 0 for stale handles
+void* HandleFree(HandleTable* Table, uint32_t Handle)
+{
+	void* Object = HandleLookup(Table, Handle);
+	if (!Object) return 0;
+
+	int Index = HandleIndex(Handle);
+	HandleSlot* Slot = (HandleSlot*)Table->Slots.Data + Index;
+	Slot->Object = 0;
+	Slot->Generation++;
+	Slot->NextFree = Table->FreeHead;
+	Table->FreeHead = Index;
+
+	return Object;
+}
+
 /*
 * /HELPER FUNCS AND STRUCTS
 */
@@ -307,6 +409,9 @@ typedef struct
 	_Vector TriangleVertexData[3];
 } Triangle;
 
+// Scratch memory of the draw call being executed, reset after each of its instances
+_Arena* DrawArena;
+
 glslVec4 IntersectNearPlane(glslVec4 a, glslVec4 b, float* t)
 {
 	*t = (a.z + a.w) / (a.w - b.w + a.z - b.z);
@@ -351,6 +456,7 @@ glslExValue InterpolateExValue(glslExValue Val0, glslExValue Val1, float t)
 	return Out;
 }
 
+// The clipped triangles' vertex data comes from DrawArena, the caller releases it after rasterizing them
 int ClipTriangleAgainstNearPlane(Triangle* tri, Triangle* outTri)
 {
 
@@ -358,8 +464,8 @@ int ClipTriangleAgainstNearPlane(Triangle* tri, Triangle* outTri)
 	{
 		outTri[0].Verts[i] = tri->Verts[i];
 		outTri[1].Verts[i] = tri->Verts[i];
-		outTri[0].TriangleVertexData[i] = NewVector(sizeof(_ExVarPair));
-		outTri[1].TriangleVertexData[i] = NewVector(sizeof(_ExVarPair));
+		outTri[0].TriangleVertexData[i] = NewArenaVector(DrawArena, sizeof(_ExVarPair), tri->TriangleVertexData[i].Size + 1);
+		outTri[1].TriangleVertexData[i] = NewArenaVector(DrawArena, sizeof(_ExVarPair), tri->TriangleVertexData[i].Size + 1);
 		for (int j = 0; j < tri->TriangleVertexData[i].Size; j++)
 		{
 			_ExVarPair Pair;
@@ -371,93 +477,52 @@ int ClipTriangleAgainstNearPlane(Triangle* tri, Triangle* outTri)
 		}
 	}
 
+	// Only ever read, they can share the storage of the input vertices
 	glslVec4* InsidePoints[3];  int nInsidePointCount = 0;
 	_Vector InExValues[3];
 	glslVec4* OutsidePoints[3]; int nOutsidePointCount = 0;
 	_Vector OutExValues[3];
 
-	InExValues[0] = NewVector(sizeof(_ExVarPair));
-	InExValues[1] = NewVector(sizeof(_ExVarPair));
-	InExValues[2] = NewVector(sizeof(_ExVarPair));
-
-	OutExValues[0] = NewVector(sizeof(_ExVarPair));
-	OutExValues[1] = NewVector(sizeof(_ExVarPair));
-	OutExValues[2] = NewVector(sizeof(_ExVarPair));
-
 	if (tri->Verts[0].z >= -tri->Verts[0].w)
 	{
-		VectorCopy(&InExValues[nInsidePointCount], &tri->TriangleVertexData[0]);
+		InExValues[nInsidePointCount] = tri->TriangleVertexData[0];
 		InsidePoints[nInsidePointCount++] = &tri->Verts[0];
 	}
 	else
 	{
-		VectorCopy(&OutExValues[nOutsidePointCount], &tri->TriangleVertexData[0]);
+		OutExValues[nOutsidePointCount] = tri->TriangleVertexData[0];
 		OutsidePoints[nOutsidePointCount++] = &tri->Verts[0];
 	}
 	if (tri->Verts[1].z >= -tri->Verts[1].w)
 	{
-		VectorCopy(&InExValues[nInsidePointCount], &tri->TriangleVertexData[1]);
+		InExValues[nInsidePointCount] = tri->TriangleVertexData[1];
 		InsidePoints[nInsidePointCount++] = &tri->Verts[1];
 	}
 	else
 	{
-		VectorCopy(&OutExValues[nOutsidePointCount], &tri->TriangleVertexData[1]);
+		OutExValues[nOutsidePointCount] = tri->TriangleVertexData[1];
 		OutsidePoints[nOutsidePointCount++] = &tri->Verts[1];
 	}
 	if (tri->Verts[2].z >= -tri->Verts[2].w)
 	{
-		VectorCopy(&InExValues[nInsidePointCount], &tri->TriangleVertexData[2]);
+		InExValues[nInsidePointCount] = tri->TriangleVertexData[2];
 		InsidePoints[nInsidePointCount++] = &tri->Verts[2];
 	}
 	else
 	{
-		VectorCopy(&OutExValues[nOutsidePointCount], &tri->TriangleVertexData[2]);
+		OutExValues[nOutsidePointCount] = tri->TriangleVertexData[2];
 		OutsidePoints[nOutsidePointCount++] = &tri->Verts[2];
 	}
 
 	if (nInsidePointCount == 0)
 	{
-		VectorFree(&InExValues[0]);
-		VectorFree(&InExValues[1]);
-		VectorFree(&InExValues[2]);
-
-		VectorFree(&OutExValues[0]);
-		VectorFree(&OutExValues[1]);
-		VectorFree(&OutExValues[2]);
-
-		VectorFree(&outTri[0].TriangleVertexData[0]);
-		VectorFree(&outTri[0].TriangleVertexData[1]);
-		VectorFree(&outTri[0].TriangleVertexData[2]);
-
-		VectorFree(&outTri[1].TriangleVertexData[0]);
-		VectorFree(&outTri[1].TriangleVertexData[1]);
-		VectorFree(&outTri[1].TriangleVertexData[2]);
-
 		return 0;
 	}
 
 	if (nInsidePointCount == 3)
 	{
-		VectorFree(&outTri[0].TriangleVertexData[0]);
-		VectorFree(&outTri[0].TriangleVertexData[1]);
-		VectorFree(&outTri[0].TriangleVertexData[2]);
-
-		VectorFree(&outTri[1].TriangleVertexData[0]);
-		VectorFree(&outTri[1].TriangleVertexData[1]);
-		VectorFree(&outTri[1].TriangleVertexData[2]);
-
 		outTri[0] = *tri;
 
-		VectorFree(&InExValues[0]);
-		VectorFree(&InExValues[1]);
-		VectorFree(&InExValues[2]);
-
-		VectorFree(&OutExValues[0]);
-		VectorFree(&OutExValues[1]);
-		VectorFree(&OutExValues[2]);
-
-
-
 		return 1;
 	}
 
@@ -489,19 +554,6 @@ int ClipTriangleAgainstNearPlane(Triangle* tri, Triangle* outTri)
 			VectorWrite(&outTri[0].TriangleVertexData[2], &Pair0, i);
 		}
 
-		VectorFree(&InExValues[0]);
-		VectorFree(&InExValues[1]);
-		VectorFree(&InExValues[2]);
-
-		VectorFree(&OutExValues[0]);
-		VectorFree(&OutExValues[1]);
-		VectorFree(&OutExValues[2]);
-
-		VectorFree(&outTri[1].TriangleVertexData[0]);
-		VectorFree(&outTri[1].TriangleVertexData[1]);
-		VectorFree(&outTri[1].TriangleVertexData[2]);
-
-
 		return 1;
 	}
 
@@ -539,14 +591,6 @@ int ClipTriangleAgainstNearPlane(Triangle* tri, Triangle* outTri)
 			VectorWrite(&outTri[1].TriangleVertexData[2], &Pair0, i);
 		}
 
-		VectorFree(&InExValues[0]);
-		VectorFree(&InExValues[1]);
-		VectorFree(&InExValues[2]);
-
-		VectorFree(&OutExValues[0]);
-		VectorFree(&OutExValues[1]);
-		VectorFree(&OutExValues[2]);
-
 		return 2;
 	}
 }
@@ -1707,6 +1751,19 @@ glslTokenized GLSLTokenize(_String* ToTokenize)
 
 	VectorPushBack(&Tokenizer->GlobalVars, &PositionVariable);
 
+	// An int, set to the instance number by glDrawArraysInstanced before each instance is drawn
+	glslVariable* InstanceIDVariable = (glslVariable*)malloc(sizeof(glslVariable));
+	InstanceIDVariable->Name = CString2String("gl_InstanceID");
+	InstanceIDVariable->Type = GLSL_INT;
+	InstanceIDVariable->isIn = 0;
+	InstanceIDVariable->isOut = 0;
+	InstanceIDVariable->isLayout = 0;
+	InstanceIDVariable->isUniform = 0;
+	InstanceIDVariable->Value.Alloc = 0;
+	InstanceIDVariable->HasAddr = 0;
+
+	VectorPushBack(&Tokenizer->GlobalVars, &InstanceIDVariable);
+
 	while (Tokenizer->At < Tokenizer->Code->Size - 2)
 	{
 		glslFunction* DispatchResult = GLSLDispatchTokenize(Tokenizer);
@@ -1890,6 +1947,26 @@ glslExValue VarToExVal(glslVariable* Var)
 	return Out;
 }
 
+/*
+* Every mip level, level 0 included, is stored the same way so the shader code can sample any of them:
+* a TextureLevelHeader followed by the texels, RGBA floats in the order picked by the texture's layout.
+* Texel (x, y) lives XOffsets[x] + YOffsets[y] bytes past the header whatever the layout is.
+* Block compressed levels store 4x4 blocks in rows instead, and the same sum gives the byte offset
+* of the block shifted left by 4 with the index of the texel inside the block in the low 4 bits.
+*/
+typedef struct
+{
+	float Width;
+	float Height;
+	uint32_t* XOffsets;
+	uint32_t* YOffsets;
+	uint32_t CompressedFormat; // 0 for RGBA float texels
+	uint32_t Padding[3];
+} TextureLevelHeader;
+
+#define TEXTURE_LEVEL_HEADER_SIZE 32
+#define TEXTURE_BLOCK_BYTES 8 // BC1 and BC4 both pack a 4x4 block into 8 bytes
+
 typedef struct
 {
 	float* Data;
@@ -1906,10 +1983,11 @@ typedef struct
 	int Height;
 	GLenum SRepeat;
 	GLenum TRepeat;
-	int Idx;
+	GLenum Layout;
+	uint32_t CompressedFormat;
 } Texture2D;
 
-_Vector GlobalTextures;
+HandleTable GlobalTextures;
 Texture2D* ActiveTexture2D;
 Texture2D* TextureUnits[8];
 int ActiveTextureUnit;
@@ -1918,19 +1996,365 @@ void* GlobalCodeAddr;
 
 uint32_t GlobalTextureTableAddr;
 
+int TextureLayoutTileSize(GLenum Layout)
+{
+	if (Layout == GL_TEXTURE_LAYOUT_TILED_4X4) return 4;
+	if (Layout == GL_TEXTURE_LAYOUT_TILED_8X8) return 8;
+	return 1;
+}
+
+// Spreads the bits of Value apart so an X and a Y can be interleaved into a Morton (Z-order) index
+uint32_t MortonSpread(uint32_t Value)
+{
+	uint32_t Out = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		Out |= ((Value >> i) & 1) << (i * 2);
+	}
+	return Out;
+}
+
+// Allocates a level with room for StorageBytes of texels, its offset tables are left for the caller to fill
+TextureLevelHeader* TextureAllocLevelHeader(int Width, int Height, uint32_t StorageBytes, uint32_t CompressedFormat)
+{
+	// One extra entry per table so a coordinate that rounds up to the edge still lands on the last texel
+	TextureLevelHeader* Level = (TextureLevelHeader*)malloc(TEXTURE_LEVEL_HEADER_SIZE + StorageBytes + 4 * (Width + 1) + 4 * (Height + 1));
+	Level->Width = Width;
+	Level->Height = Height;
+	Level->XOffsets = (uint32_t*)((uint8_t*)Level + TEXTURE_LEVEL_HEADER_SIZE + StorageBytes);
+	Level->YOffsets = Level->XOffsets + Width + 1;
+	Level->CompressedFormat = CompressedFormat;
+	return Level;
+}
+
+/*
+* Tiled layouts store the level as rows of Tile x Tile blocks, with the texels inside a block in Morton order.
+* A 2x2 quad of texels then shares one 64 byte cache line and walking the texture vertically or diagonally
+* stays inside the same few lines instead of jumping a whole row each step.
+*/
+float* TextureAllocLevel(int Width, int Height, GLenum Layout)
+{
+	int Tile = TextureLayoutTileSize(Layout);
+	int PaddedWidth = (Width + Tile - 1) / Tile * Tile;
+	int PaddedHeight = (Height + Tile - 1) / Tile * Tile;
+
+	TextureLevelHeader* Level = TextureAllocLevelHeader(Width, Height, 16 * PaddedWidth * PaddedHeight, 0);
+
+	for (int x = 0; x <= Width; x++)
+	{
+		int TexelX = MIN(x, Width - 1);
+		if (Tile == 1) Level->XOffsets[x] = 16 * TexelX;
+		else Level->XOffsets[x] = 16 * ((TexelX / Tile) * Tile * Tile + MortonSpread(TexelX % Tile));
+	}
+
+	for (int y = 0; y <= Height; y++)
+	{
+		int TexelY = MIN(y, Height - 1);
+		if (Tile == 1) Level->YOffsets[y] = 16 * TexelY * Width;
+		else Level->YOffsets[y] = 16 * ((TexelY / Tile) * PaddedWidth * Tile + (MortonSpread(TexelY % Tile) << 1));
+	}
+
+	return (float*)Level;
+}
+
+uint32_t TextureCompressedSize(int Width, int Height)
+{
+	return ((Width + 3) / 4) * ((Height + 3) / 4) * TEXTURE_BLOCK_BYTES;
+}
+
+float* TextureAllocCompressedLevel(int Width, int Height, uint32_t Format)
+{
+	int BlocksWide = (Width + 3) / 4;
+
+	TextureLevelHeader* Level = TextureAllocLevelHeader(Width, Height, TextureCompressedSize(Width, Height), Format);
+
+	for (int x = 0; x <= Width; x++)
+	{
+		int TexelX = MIN(x, Width - 1);
+		Level->XOffsets[x] = (((TexelX / 4) * TEXTURE_BLOCK_BYTES) << 4) | (TexelX & 3);
+	}
+
+	for (int y = 0; y <= Height; y++)
+	{
+		int TexelY = MIN(y, Height - 1);
+		Level->YOffsets[y] = (((TexelY / 4) * BlocksWide * TEXTURE_BLOCK_BYTES) << 4) | ((TexelY & 3) << 2);
+	}
+
+	return (float*)Level;
+}
+
+uint8_t* TextureLevelBlocks(float* Level)
+{
+	return (uint8_t*)Level + TEXTURE_LEVEL_HEADER_SIZE;
+}
+
+// Only valid for RGBA float levels, TextureLevelFetch works with every level
+float* TextureLevelTexel(float* Level, int x, int y)
+{
+	TextureLevelHeader* Header = (TextureLevelHeader*)Level;
+	return (float*)((uint8_t*)Level + TEXTURE_LEVEL_HEADER_SIZE + Header->XOffsets[x] + Header->YOffsets[y]);
+}
+
+uint16_t Bc1Pack565(float* Color)
+{
+	int Red = MIN(MAX(Color[0], 0.0f), 1.0f) * 31.0f + 0.5f;
+	int Green = MIN(MAX(Color[1], 0.0f), 1.0f) * 63.0f + 0.5f;
+	int Blue = MIN(MAX(Color[2], 0.0f), 1.0f) * 31.0f + 0.5f;
+	return (Red << 11) | (Green << 5) | Blue;
+}
+
+// The four RGBA colors a BC1 block selects from. Color0 <= Color1 switches to three colors plus transparent black.
+void Bc1Palette(uint16_t Color0, uint16_t Color1, float Palette[4][4])
+{
+	uint16_t Colors[2] = { Color0, Color1 };
+	for (int i = 0; i < 2; i++)
+	{
+		Palette[i][0] = (Colors[i] >> 11) / 31.0f;
+		Palette[i][1] = ((Colors[i] >> 5) & 63) / 63.0f;
+		Palette[i][2] = (Colors[i] & 31) / 31.0f;
+		Palette[i][3] = 1.0f;
+	}
+
+	for (int c = 0; c < 4; c++)
+	{
+		if (Color0 > Color1)
+		{
+			Palette[2][c] = (2.0f * Palette[0][c] + Palette[1][c]) / 3.0f;
+			Palette[3][c] = (Palette[0][c] + 2.0f * Palette[1][c]) / 3.0f;
+		}
+		else
+		{
+			Palette[2][c] = (Palette[0][c] + Palette[1][c]) / 2.0f;
+			Palette[3][c] = 0.0f;
+		}
+	}
+}
+
+// The eight values a BC4 block selects from. Red0 <= Red1 switches to six values plus 0 and 1.
+void Bc4Palette(int Red0, int Red1, float Palette[8])
+{
+	Palette[0] = Red0 / 255.0f;
+	Palette[1] = Red1 / 255.0f;
+
+	if (Red0 > Red1)
+	{
+		for (int i = 2; i < 8; i++) Palette[i] = ((8 - i) * Red0 + (i - 1) * Red1) / (7.0f * 255.0f);
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++) Palette[i] = ((6 - i) * Red0 + (i - 1) * Red1) / (5.0f * 255.0f);
+		Palette[6] = 0.0f;
+		Palette[7] = 1.0f;
+	}
+}
+
+int Bc4Selector(uint8_t* Block, int Index)
+{
+	int Bit = Index * 3;
+	int Bits = Block[2 + Bit / 8];
+	if (Bit % 8 > 5) Bits |= Block[3 + Bit / 8] << 8;
+	return (Bits >> (Bit % 8)) & 7;
+}
+
+// RGBA of the texel decoded by the last TextureDecodeTexel call, the shader code loads it from here
+float TextureDecodedTexel[4];
+// Where the shader code keeps xmm0-3 while it calls TextureDecodeTexel
+float TextureSampleSpill[16];
+
+// Called from the shader code with the offset sum of a compressed level, see TextureLevelHeader
+void TextureDecodeTexel(TextureLevelHeader* Level, uint32_t Offset)
+{
+	uint8_t* Block = (uint8_t*)Level + TEXTURE_LEVEL_HEADER_SIZE + (Offset >> 4);
+	int Index = Offset & 15;
+
+	if (Level->CompressedFormat == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+	{
+		float Palette[4][4];
+		Bc1Palette(Block[0] | (Block[1] << 8), Block[2] | (Block[3] << 8), Palette);
+
+		int Selector = (Block[4 + Index / 4] >> ((Index % 4) * 2)) & 3;
+		for (int c = 0; c < 4; c++) TextureDecodedTexel[c] = Palette[Selector][c];
+	}
+	else if (Level->CompressedFormat == GL_COMPRESSED_RED_RGTC1)
+	{
+		float Palette[8];
+		Bc4Palette(Block[0], Block[1], Palette);
+
+		TextureDecodedTexel[0] = Palette[Bc4Selector(Block, Index)];
+		TextureDecodedTexel[1] = 0.0f;
+		TextureDecodedTexel[2] = 0.0f;
+		TextureDecodedTexel[3] = 1.0f;
+	}
+}
+
+// Compressed levels are decoded into TextureDecodedTexel, so the result only lives until the next fetch
+float* TextureLevelFetch(float* Level, int x, int y)
+{
+	TextureLevelHeader* Header = (TextureLevelHeader*)Level;
+	if (!Header->CompressedFormat) return TextureLevelTexel(Level, x, y);
+
+	TextureDecodeTexel(Header, Header->XOffsets[x] + Header->YOffsets[y]);
+	return TextureDecodedTexel;
+}
+
+// Bounding box encoder, good enough for mip levels generated at runtime
+void TextureEncodeBlock(uint32_t Format, float Texels[16][4], uint8_t* Block)
+{
+	if (Format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT)
+	{
+		float Min[3] = { 1.0f, 1.0f, 1.0f };
+		float Max[3] = { 0.0f, 0.0f, 0.0f };
+		uint8_t HasTransparent = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			if (Texels[i][3] < 0.5f)
+			{
+				HasTransparent = 1;
+				continue;
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				Min[c] = MIN(Min[c], Texels[i][c]);
+				Max[c] = MAX(Max[c], Texels[i][c]);
+			}
+		}
+
+		uint16_t Color0 = Bc1Pack565(Max);
+		uint16_t Color1 = Bc1Pack565(Min);
+
+		// Three color mode (Color0 <= Color1) is the only one with a transparent entry
+		if ((HasTransparent && Color0 > Color1) || (!HasTransparent && Color0 < Color1))
+		{
+			uint16_t Swap = Color0;
+			Color0 = Color1;
+			Color1 = Swap;
+		}
+
+		float Palette[4][4];
+		Bc1Palette(Color0, Color1, Palette);
+
+		Block[0] = Color0 & 0xFF;
+		Block[1] = Color0 >> 8;
+		Block[2] = Color1 & 0xFF;
+		Block[3] = Color1 >> 8;
+		Block[4] = Block[5] = Block[6] = Block[7] = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int Selector = 3;
+			if (!HasTransparent || Texels[i][3] >= 0.5f)
+			{
+				float BestDist = 1e30f;
+				for (int s = 0; s < (HasTransparent ? 3 : 4); s++)
+				{
+					float Dist = 0.0f;
+					for (int c = 0; c < 3; c++) Dist += (Texels[i][c] - Palette[s][c]) * (Texels[i][c] - Palette[s][c]);
+					if (Dist < BestDist)
+					{
+						BestDist = Dist;
+						Selector = s;
+					}
+				}
+			}
+			Block[4 + i / 4] |= Selector << ((i % 4) * 2);
+		}
+	}
+	else if (Format == GL_COMPRESSED_RED_RGTC1)
+	{
+		int Red0 = 0;
+		int Red1 = 255;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int Red = MIN(MAX(Texels[i][0], 0.0f), 1.0f) * 255.0f + 0.5f;
+			Red0 = MAX(Red0, Red);
+			Red1 = MIN(Red1, Red);
+		}
+
+		float Palette[8];
+		Bc4Palette(Red0, Red1, Palette);
+
+		Block[0] = Red0;
+		Block[1] = Red1;
+		for (int i = 2; i < 8; i++) Block[i] = 0;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int Selector = 0;
+			float BestDist = 1e30f;
+			for (int s = 0; s < 8; s++)
+			{
+				float Dist = (Texels[i][0] - Palette[s]) * (Texels[i][0] - Palette[s]);
+				if (Dist < BestDist)
+				{
+					BestDist = Dist;
+					Selector = s;
+				}
+			}
+
+			int Bit = i * 3;
+			Block[2 + Bit / 8] |= (Selector << (Bit % 8)) & 0xFF;
+			if (Bit % 8 > 5) Block[3 + Bit / 8] |= Selector >> (8 - Bit % 8);
+		}
+	}
+}
+
+void TextureFreeMipMaps(Texture2D* Texture)
+{
+	for (int i = 0; i < Texture->MipMaps.Size; i++)
+	{
+		MipMap2D MipMap;
+		VectorRead(&Texture->MipMaps, &MipMap, i);
+		free(MipMap.Data);
+	}
+	Texture->MipMaps.Size = 0;
+}
+
 void glGenTextures(GLsizei n, GLuint* textures)
 {
-	Texture2D* Texture = (Texture2D*)malloc(sizeof(Texture2D));
-	Texture->Data = 0;
-	Texture->FloatsPerPixel = 3;
-	Texture->Width = 0;
-	Texture->Height = 0;
-	Texture->SRepeat = GL_REPEAT;
-	Texture->TRepeat = GL_REPEAT;
-	Texture->MipMaps = NewVector(sizeof(MipMap2D));
-	Texture->Idx = GlobalTextures.Size;
-	VectorPushBack(&GlobalTextures, &Texture);
-	*textures = GlobalTextures.Size;
+	for (int i = 0; i < n; i++)
+	{
+		Texture2D* Texture = (Texture2D*)malloc(sizeof(Texture2D));
+		Texture->Data = 0;
+		Texture->FloatsPerPixel = 3;
+		Texture->Width = 0;
+		Texture->Height = 0;
+		Texture->SRepeat = GL_REPEAT;
+		Texture->TRepeat = GL_REPEAT;
+		Texture->Layout = GL_TEXTURE_LAYOUT_LINEAR;
+		Texture->CompressedFormat = 0;
+		Texture->MipMaps = NewVector(sizeof(MipMap2D));
+		textures[i] = HandleAlloc(&GlobalTextures, Texture);
+	}
+}
+
+void FramebufferDetachTexture(Texture2D* Texture);
+
+void glDeleteTextures(GLsizei n, const GLuint* textures)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (textures[i] == 0) continue;
+
+		Texture2D* Texture = (Texture2D*)HandleFree(&GlobalTextures, textures[i]);
+		if (!Texture) continue;
+
+		// Deleting a bound texture unbinds it from every unit
+		if (ActiveTexture2D == Texture) ActiveTexture2D = 0;
+		for (int Unit = 0; Unit < 8; Unit++)
+		{
+			if (TextureUnits[Unit] != Texture) continue;
+			TextureUnits[Unit] = 0;
+			((uint32_t*)GlobalTextureTableAddr)[Unit] = 0;
+		}
+		FramebufferDetachTexture(Texture);
+
+		TextureFreeMipMaps(Texture);
+		free(Texture->MipMaps.Data);
+		if (Texture->Data) free(Texture->Data);
+		free(Texture);
+	}
 }
 
 void glBindTexture(GLenum target, GLuint texture)
@@ -1944,8 +2368,11 @@ void glBindTexture(GLenum target, GLuint texture)
 		}
 		else
 		{
-			VectorRead(&GlobalTextures, &ActiveTexture2D, texture - 1);
-			VectorRead(&GlobalTextures, &TextureUnits[ActiveTextureUnit], texture - 1);
+			Texture2D* Texture = (Texture2D*)HandleLookup(&GlobalTextures, texture);
+			if (!Texture) return;
+
+			ActiveTexture2D = Texture;
+			TextureUnits[ActiveTextureUnit] = Texture;
 			
 			((uint32_t*)GlobalTextureTableAddr)[ActiveTextureUnit] = (uint32_t)TextureUnits[ActiveTextureUnit]->Data;
 		}
@@ -1970,18 +2397,58 @@ void glTexParameteri(GLenum target, GLenum type, GLenum mode)
 		{
 			ActiveTexture2D->TRepeat = mode;
 		}
+		if (type == GL_TEXTURE_LAYOUT)
+		{
+			ActiveTexture2D->Layout = mode; // Takes effect on the next glTexImage2D
+		}
+	}
+}
+
+// Row length in pixels of the client images read by glTexImage2D and glTexSubImage2D, 0 means the image width
+GLint GlobalUnpackRowLength;
+
+void glPixelStorei(GLenum pname, GLint param)
+{
+	if (pname == GL_UNPACK_ROW_LENGTH)
+	{
+		GlobalUnpackRowLength = param;
+	}
+}
+
+// Converts width * height client pixels to float texels of Level, starting at texel (X, Y)
+void TextureUnpackRect(Texture2D* Texture, float* Level, int X, int Y, int width, int height, GLenum type, const void* data)
+{
+	int RowLength = GlobalUnpackRowLength > 0 ? GlobalUnpackRowLength : width;
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			int i = x + y * RowLength;
+			float* Texel = TextureLevelTexel(Level, X + x, Y + y);
+			Texel[0] = 0.0f;
+			Texel[1] = 0.0f;
+			Texel[2] = 0.0f;
+			Texel[3] = 1.0f;
+			for (int j = 0; j < Texture->FloatsPerPixel; j++)
+			{
+				if (type == GL_FLOAT) Texel[j] = ((float*)data)[i * Texture->FloatsPerPixel + j];
+				if (type == GL_UNSIGNED_BYTE) Texel[j] = ((uint8_t*)data)[i * Texture->FloatsPerPixel + j] / 255.0f;
+			}
+		}
 	}
 }
 
 void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* data)
 {
-	if (!data) return;
 	if (border != 0) return; // By specification, must always be 0
 
 	if (target == GL_TEXTURE_2D)
 	{
 		if (!ActiveTexture2D) return;
 		if (ActiveTexture2D->Data) free(ActiveTexture2D->Data);
+		ActiveTexture2D->Data = 0;
+		TextureFreeMipMaps(ActiveTexture2D);
 		if (internalformat != format) return; // Must be the same format for both output and input
 		if (internalformat == GL_RGBA) ActiveTexture2D->FloatsPerPixel = 4;
 		if (internalformat == GL_RGB) ActiveTexture2D->FloatsPerPixel = 3;
@@ -1990,81 +2457,191 @@ void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei widt
 
 		ActiveTexture2D->Width = width;
 		ActiveTexture2D->Height = height;
+		ActiveTexture2D->CompressedFormat = 0;
 
-		ActiveTexture2D->Data = (float*)malloc(4 * width * height * sizeof(float) + 8);
+		ActiveTexture2D->Data = TextureAllocLevel(width, height, ActiveTexture2D->Layout);
 		
 		((uint32_t*)GlobalTextureTableAddr)[ActiveTextureUnit] = (uint32_t)ActiveTexture2D->Data;
-		((float*)ActiveTexture2D->Data)[0] = width;
-		((float*)ActiveTexture2D->Data)[1] = height;
 
-		float* StepData = ActiveTexture2D->Data;
-
-		for (int i = 0; i < width * height; i++)
-		{
-			ActiveTexture2D->Data[2 + i * 4 + 3] = 1.0f;
-			for (int j = 0; j < ActiveTexture2D->FloatsPerPixel; j++)
-			{
-				if (type == GL_FLOAT) ActiveTexture2D->Data[i * 4 + j + 2] = ((float*)data)[i * ActiveTexture2D->FloatsPerPixel + j];
-				if (type == GL_UNSIGNED_BYTE) ActiveTexture2D->Data[i * 4 + j + 2] = ((uint8_t*)data)[i * ActiveTexture2D->FloatsPerPixel + j] / 255.0f;
-			}
-		}
+		// Without data the texels are left undefined, like a texture meant to be rendered to
+		if (data) TextureUnpackRect(ActiveTexture2D, ActiveTexture2D->Data, 0, 0, width, height, type, data);
 	}
 }
 
-void glGenerateMipmap(GLenum target)
+void glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void* data)
 {
+	if (!data) return;
+	if (border != 0) return; // By specification, must always be 0
+	if (internalformat != GL_COMPRESSED_RGBA_S3TC_DXT1_EXT && internalformat != GL_COMPRESSED_RED_RGTC1) return;
+	if (imageSize != TextureCompressedSize(width, height)) return;
+
 	if (target == GL_TEXTURE_2D)
 	{
 		if (!ActiveTexture2D) return;
-		if (!ActiveTexture2D->Data) return;
+		if (ActiveTexture2D->Data) free(ActiveTexture2D->Data);
+		ActiveTexture2D->Data = 0;
+		TextureFreeMipMaps(ActiveTexture2D);
 
-		int CurWidth = ActiveTexture2D->Width / 2;
-		int CurHeight = ActiveTexture2D->Height / 2;
+		ActiveTexture2D->FloatsPerPixel = internalformat == GL_COMPRESSED_RED_RGTC1 ? 1 : 4;
+		ActiveTexture2D->Width = width;
+		ActiveTexture2D->Height = height;
+		ActiveTexture2D->CompressedFormat = internalformat;
 
-		float* PrevPtr = ActiveTexture2D->Data;
+		// The blocks stay compressed, the sampler decodes the texel it needs
+		ActiveTexture2D->Data = TextureAllocCompressedLevel(width, height, internalformat);
+		memcpy(TextureLevelBlocks(ActiveTexture2D->Data), data, imageSize);
 
-		while (CurWidth + CurHeight > 4)
-		{
-			float* CurPtr = (float*)malloc(CurWidth * CurHeight * sizeof(float) * ActiveTexture2D->FloatsPerPixel);
+		((uint32_t*)GlobalTextureTableAddr)[ActiveTextureUnit] = (uint32_t)ActiveTexture2D->Data;
+	}
+}
 
-			for (int y = 0; y < CurHeight; y++)
-			{
-				for (int x = 0; x < CurWidth; x++)
-				{
-					float* CurPixel = CurPtr + ActiveTexture2D->FloatsPerPixel * (x + y * CurWidth);
-					if (ActiveTexture2D->FloatsPerPixel >= 1) CurPixel[0] = 0.0f;
-					if (ActiveTexture2D->FloatsPerPixel >= 2) CurPixel[1] = 0.0f;
-					if (ActiveTexture2D->FloatsPerPixel >= 3) CurPixel[2] = 0.0f;
-					if (ActiveTexture2D->FloatsPerPixel == 4) CurPixel[3] = 0.0f;
-					for (int sY = 0; sY < 2; sY++)
+// 2x2 box filter of level Prev for texel (x, y) of the level below it. Odd edges reuse the last row/column.
+__m128 TextureBoxFilter(float* Prev, int PrevWidth, int PrevHeight, int x, int y)
+{
+	int X0 = MIN(x * 2, PrevWidth - 1);
+	int X1 = MIN(x * 2 + 1, PrevWidth - 1);
+	int Y0 = MIN(y * 2, PrevHeight - 1);
+	int Y1 = MIN(y * 2 + 1, PrevHeight - 1);
+
+	// One load per statement, a compressed fetch is only valid until the next one
+	__m128 Sum = _mm_loadu_ps(TextureLevelFetch(Prev, X0, Y0));
+	Sum = _mm_add_ps(Sum, _mm_loadu_ps(TextureLevelFetch(Prev, X1, Y0)));
+	Sum = _mm_add_ps(Sum, _mm_loadu_ps(TextureLevelFetch(Prev, X0, Y1)));
+	Sum = _mm_add_ps(Sum, _mm_loadu_ps(TextureLevelFetch(Prev, X1, Y1)));
+
+	return _mm_mul_ps(Sum, _mm_set1_ps(0.25f));
+}
+
+// Refilters the texels of every mip level that depend on the level 0 rectangle [X0, X1) x [Y0, Y1)
+void TextureUpdateMipMaps(Texture2D* Texture, int X0, int Y0, int X1, int Y1)
+{
+	float* PrevPtr = Texture->Data;
+	int PrevWidth = Texture->Width;
+	int PrevHeight = Texture->Height;
+
+	for (int i = 0; i < Texture->MipMaps.Size; i++)
+	{
+		MipMap2D MipMap;
+		VectorRead(&Texture->MipMaps, &MipMap, i);
+
+		// Texel x of this level covers x * 2 and x * 2 + 1 of the previous one
+		X0 = X0 / 2;
+		Y0 = Y0 / 2;
+		X1 = MIN((X1 + 1) / 2, MipMap.Width);
+		Y1 = MIN((Y1 + 1) / 2, MipMap.Height);
+
+		for (int y = Y0; y < Y1; y++)
+		{
+			for (int x = X0; x < X1; x++)
+			{
+				_mm_storeu_ps(TextureLevelTexel(MipMap.Data, x, y), TextureBoxFilter(PrevPtr, PrevWidth, PrevHeight, x, y));
+			}
+		}
+
+		PrevPtr = MipMap.Data;
+		PrevWidth = MipMap.Width;
+		PrevHeight = MipMap.Height;
+	}
+}
+
+void glGenerateMipmap(GLenum target)
+{
+	if (target == GL_TEXTURE_2D)
+	{
+		if (!ActiveTexture2D) return;
+		if (!ActiveTexture2D->Data) return;
+
+		TextureFreeMipMaps(ActiveTexture2D);
+
+		int PrevWidth = ActiveTexture2D->Width;
+		int PrevHeight = ActiveTexture2D->Height;
+		float* PrevPtr = ActiveTexture2D->Data;
+		uint32_t Format = ActiveTexture2D->CompressedFormat;
+
+		while (PrevWidth > 1 || PrevHeight > 1)
+		{
+			int CurWidth = MAX(PrevWidth / 2, 1);
+			int CurHeight = MAX(PrevHeight / 2, 1);
+
+			float* CurPtr;
+
+			if (Format)
+			{
+				// Filter a whole 4x4 block at a time and compress it again
+				CurPtr = TextureAllocCompressedLevel(CurWidth, CurHeight, Format);
+				uint8_t* Block = TextureLevelBlocks(CurPtr);
+
+				for (int by = 0; by < CurHeight; by += 4)
+				{
+					for (int bx = 0; bx < CurWidth; bx += 4)
 					{
-						for (int sX = 0; sX < 2; sX++)
+						float Texels[16][4];
+						for (int i = 0; i < 16; i++)
 						{
-							float* PrevPixel = PrevPtr + ActiveTexture2D->FloatsPerPixel * ((x * 2 + sX) + (y * 2 + sY) * CurWidth * 2);
-							if (ActiveTexture2D->FloatsPerPixel >= 1) CurPixel[0] += PrevPixel[0];
-							if (ActiveTexture2D->FloatsPerPixel >= 2) CurPixel[1] += PrevPixel[1];
-							if (ActiveTexture2D->FloatsPerPixel >= 3) CurPixel[2] += PrevPixel[2];
-							if (ActiveTexture2D->FloatsPerPixel == 4) CurPixel[3] += PrevPixel[3];
+							_mm_storeu_ps(Texels[i], TextureBoxFilter(PrevPtr, PrevWidth, PrevHeight, MIN(bx + i % 4, CurWidth - 1), MIN(by + i / 4, CurHeight - 1)));
 						}
+
+						TextureEncodeBlock(Format, Texels, Block);
+						Block += TEXTURE_BLOCK_BYTES;
 					}
-					if (ActiveTexture2D->FloatsPerPixel >= 1) CurPixel[0] /= 4.0f;
-					if (ActiveTexture2D->FloatsPerPixel >= 2) CurPixel[1] /= 4.0f;
-					if (ActiveTexture2D->FloatsPerPixel >= 3) CurPixel[2] /= 4.0f;
-					if (ActiveTexture2D->FloatsPerPixel == 4) CurPixel[3] /= 4.0f;
 				}
 			}
+			else
+			{
+				CurPtr = TextureAllocLevel(CurWidth, CurHeight, ActiveTexture2D->Layout); // Filled below
+			}
 
 			MipMap2D Mipmap = { CurPtr, CurWidth, CurHeight };
 			VectorPushBack(&ActiveTexture2D->MipMaps, &Mipmap);
 
-			CurWidth /= 2;
-			CurHeight /= 2;
+			PrevWidth = CurWidth;
+			PrevHeight = CurHeight;
 			PrevPtr = CurPtr;
 		}
+
+		if (!Format) TextureUpdateMipMaps(ActiveTexture2D, 0, 0, ActiveTexture2D->Width, ActiveTexture2D->Height);
+	}
+}
+
+// Updates part of level 0 in place, only the mip texels that depend on the rectangle are refiltered
+void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* data)
+{
+	if (!data) return;
+	if (level != 0) return; // Mip levels are only ever built by glGenerateMipmap
+
+	if (target == GL_TEXTURE_2D)
+	{
+		if (!ActiveTexture2D) return;
+		if (!ActiveTexture2D->Data) return;
+		if (ActiveTexture2D->CompressedFormat) return; // By specification, compressed textures can't be updated this way
+		if (xoffset < 0 || yoffset < 0) return;
+		if (xoffset + width > ActiveTexture2D->Width || yoffset + height > ActiveTexture2D->Height) return;
+
+		GLenum InternalFormat = GL_RGBA;
+		if (ActiveTexture2D->FloatsPerPixel == 3) InternalFormat = GL_RGB;
+		if (ActiveTexture2D->FloatsPerPixel == 2) InternalFormat = GL_RG;
+		if (ActiveTexture2D->FloatsPerPixel == 1) InternalFormat = GL_RED;
+		if (format != InternalFormat) return; // Must be the same format the texture was created with
+
+		TextureUnpackRect(ActiveTexture2D, ActiveTexture2D->Data, xoffset, yoffset, width, height, type, data);
+		TextureUpdateMipMaps(ActiveTexture2D, xoffset, yoffset, xoffset + width, yoffset + height);
 	}
 }
 
-float MipMapLevel;
+// Storage of the level each texture unit samples from for the current 2x2 quad, 0 is the base level
+float* TextureUnitLevelData(int Unit, int Level)
+{
+	Texture2D* Texture = TextureUnits[Unit];
+	if (Level <= 0 || Texture->MipMaps.Size == 0) return Texture->Data;
+
+	MipMap2D MipMap;
+	VectorRead(&Texture->MipMaps, &MipMap, MIN(Level, Texture->MipMaps.Size) - 1);
+	return MipMap.Data;
+}
+
+int TextureUnitLod[8];
+
+
 
 glslExValue ExecuteGLSLToken(glslToken* Token)
 {
@@ -2401,37 +2978,9 @@ glslExValue ExecuteGLSLToken(glslToken* Token)
 
 		Texture2D* Texture = TextureUnits[FirstResult.i];
 
-		float* TextureData = Texture->Data;
-		int TextureWidth = Texture->Width;
-		int TextureHeight = Texture->Height;
-
-		float* HigherTextureData = 0;
-		int HigherTextureWidth = 0;
-		int HigherTextureHeight = 0;
-
-		//float CurrentMipMapLevelX = TextureWidth / (TriangleMaxX - TriangleMinX);
-		//float CurrentMipMapLevelY = TextureHeight / (TriangleMaxY - TriangleMinY);
-
-		//float CurrentMipMapLevel = MAX(CurrentMipMapLevelX, CurrentMipMapLevelY);
-
-		float CurrentMipMapLevel = MipMapLevel;
-
-		if (Texture->MipMaps.Size > 0 && CurrentMipMapLevel > 0.0f)
-		{
-			MipMap2D MipMap;
-			VectorRead(&Texture->MipMaps, &MipMap, MIN(CurrentMipMapLevel, Texture->MipMaps.Size - 1));
-
-			TextureData = MipMap.Data;
-			TextureWidth = MipMap.Width;
-			TextureHeight = MipMap.Height;
-
-			VectorRead(&Texture->MipMaps, &MipMap, MIN(CurrentMipMapLevel - 1, Texture->MipMaps.Size - 1));
-
-			HigherTextureData = MipMap.Data;
-			HigherTextureWidth = MipMap.Width;
-			HigherTextureHeight = MipMap.Height;
-		}
-
+		float* TextureData = TextureUnitLevelData(FirstResult.i, TextureUnitLod[FirstResult.i]);
+		int TextureWidth = TextureData[0];
+		int TextureHeight = TextureData[1];
 
 		int TexelX = SecondResult.x * TextureWidth;
 		int TexelY = SecondResult.y * TextureHeight;
@@ -2448,43 +2997,13 @@ glslExValue ExecuteGLSLToken(glslToken* Token)
 		}
 		TexelY = MIN(MAX(TexelY, 0), TextureHeight - 1);
 
-		float* StartData = TextureData + Texture->FloatsPerPixel * (TexelX + TexelY * TextureWidth);
+		float* StartData = TextureLevelFetch(TextureData, TexelX, TexelY);
 
 		glslExValue OutVal = { GLSL_VEC4 };
-		if (Texture->FloatsPerPixel >= 1) OutVal.x = StartData[0];
-		if (Texture->FloatsPerPixel >= 2) OutVal.y = StartData[1];
-		if (Texture->FloatsPerPixel >= 3) OutVal.z = StartData[2];
-		if (Texture->FloatsPerPixel == 4) OutVal.w = StartData[3];
-
-		if (HigherTextureData)
-		{
-			int HTexelX = SecondResult.x * HigherTextureWidth;
-			int HTexelY = SecondResult.y * HigherTextureHeight;
-
-			if (Texture->SRepeat == GL_REPEAT)
-			{
-				HTexelX %= HigherTextureWidth;
-			}
-			HTexelX = MIN(MAX(HTexelX, 0), HigherTextureWidth - 1);
-
-			if (Texture->TRepeat == GL_REPEAT)
-			{
-				HTexelY %= HigherTextureHeight;
-			}
-			HTexelY = MIN(MAX(HTexelY, 0), HigherTextureHeight - 1);
-
-			StartData = HigherTextureData + Texture->FloatsPerPixel * (HTexelX + HTexelY * HigherTextureWidth);
-
-			float T = CurrentMipMapLevel - (int)CurrentMipMapLevel;
-
-			T = 1.0f - T;
-
-			if (Texture->FloatsPerPixel >= 1) OutVal.x = OutVal.x + T * (StartData[0] - OutVal.x);
-			if (Texture->FloatsPerPixel >= 2) OutVal.y = OutVal.y + T * (StartData[1] - OutVal.y);
-			if (Texture->FloatsPerPixel >= 3) OutVal.z = OutVal.z + T * (StartData[2] - OutVal.z);
-			if (Texture->FloatsPerPixel == 4) OutVal.w = OutVal.w + T * (StartData[3] - OutVal.w);
-
-		}
+		OutVal.x = StartData[0];
+		OutVal.y = StartData[1];
+		OutVal.z = StartData[2];
+		OutVal.w = StartData[3];
 
 		return OutVal;
 	}
@@ -4019,9 +4538,12 @@ CompRes CompileGLSLToken(glslToken* Token, _Vector* Out)
 		WhatTheFuck = 0xe7;
 		VectorPushBack(Out, &WhatTheFuck);
 
+		// pshufd xmm7, xmm4, 1 (fract(v) into the low lane)
+		WhatTheFuck = 0x66;
+		VectorPushBack(Out, &WhatTheFuck);
 		WhatTheFuck = 0x0f;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0xc6;
+		WhatTheFuck = 0x70;
 		VectorPushBack(Out, &WhatTheFuck);
 		WhatTheFuck = 0xfc;
 		VectorPushBack(Out, &WhatTheFuck);
@@ -4076,51 +4598,165 @@ CompRes CompileGLSLToken(glslToken* Token, _Vector* Out)
 		VectorPushBack(Out, &WhatTheFuck);
 		WhatTheFuck = 0x0f;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0x59;
+		WhatTheFuck = 0x2d;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0xfd;
+		WhatTheFuck = 0xdc;
 		VectorPushBack(Out, &WhatTheFuck);
-		
+
+		// cvtss2si ecx, xmm7 (texel y)
 		WhatTheFuck = 0xf3;
 		VectorPushBack(Out, &WhatTheFuck);
 		WhatTheFuck = 0x0f;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0x58;
+		WhatTheFuck = 0x2d;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0xe7;
+		WhatTheFuck = 0xcf;
 		VectorPushBack(Out, &WhatTheFuck);
-		
-		WhatTheFuck = 0xf3;
+
+		// mov edx, [esi + 8]; mov ebx, [edx + ebx * 4] (byte offset of the column)
+		WhatTheFuck = 0x8b;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x56;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x08;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x8b;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x1c;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x9a;
+		VectorPushBack(Out, &WhatTheFuck);
+
+		// mov edx, [esi + 12]; add ebx, [edx + ecx * 4] (plus the byte offset of the row)
+		WhatTheFuck = 0x8b;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x56;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x0c;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x03;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x1c;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x8a;
+		VectorPushBack(Out, &WhatTheFuck);
+
+		// cmp dword [esi + 16], 0; jne Compressed (level header CompressedFormat)
+		WhatTheFuck = 0x83;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x7e;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x10;
 		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x00;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x75;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x07;
+		VectorPushBack(Out, &WhatTheFuck);
+
+		// movups xmm4, [esi + ebx + 32]; jmp Done
 		WhatTheFuck = 0x0f;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0x2d;
+		WhatTheFuck = 0x10;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0xdc;
+		WhatTheFuck = 0x64;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x1e;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x20;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0xeb;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x4b;
+		VectorPushBack(Out, &WhatTheFuck);
+
+		// Compressed: TextureDecodeTexel(esi, ebx) is a C call, so keep the operands in xmm0-3 around it
+		WhatTheFuck = 0x0f;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x11;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x05;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureSampleSpill + 0, Out);
+		WhatTheFuck = 0x0f;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x11;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x0d;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureSampleSpill + 16, Out);
+		WhatTheFuck = 0x0f;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x11;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x15;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureSampleSpill + 32, Out);
+		WhatTheFuck = 0x0f;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x11;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x1d;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureSampleSpill + 48, Out);
+
+		// push ebx; push esi; mov eax, TextureDecodeTexel; call eax; add esp, 8
+		WhatTheFuck = 0x53;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x56;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0xb8;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)&TextureDecodeTexel, Out);
+		WhatTheFuck = 0xff;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0xd0;
 		VectorPushBack(Out, &WhatTheFuck);
-		
 		WhatTheFuck = 0x83;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0xc6;
+		WhatTheFuck = 0xc4;
 		VectorPushBack(Out, &WhatTheFuck);
 		WhatTheFuck = 0x08;
 		VectorPushBack(Out, &WhatTheFuck);
-		
-		WhatTheFuck = 0xc1;
+
+		WhatTheFuck = 0x0f;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0xe3;
+		WhatTheFuck = 0x10;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0x02;
+		WhatTheFuck = 0x05;
 		VectorPushBack(Out, &WhatTheFuck);
-
+		CompWriteBytes((uint32_t)TextureSampleSpill + 0, Out);
 		WhatTheFuck = 0x0f;
 		VectorPushBack(Out, &WhatTheFuck);
 		WhatTheFuck = 0x10;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0x24;
+		WhatTheFuck = 0x0d;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureSampleSpill + 16, Out);
+		WhatTheFuck = 0x0f;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x10;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x15;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureSampleSpill + 32, Out);
+		WhatTheFuck = 0x0f;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x10;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x1d;
+		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureSampleSpill + 48, Out);
+
+		// movups xmm4, [TextureDecodedTexel]
+		WhatTheFuck = 0x0f;
 		VectorPushBack(Out, &WhatTheFuck);
-		WhatTheFuck = 0x9e;
+		WhatTheFuck = 0x10;
+		VectorPushBack(Out, &WhatTheFuck);
+		WhatTheFuck = 0x25;
 		VectorPushBack(Out, &WhatTheFuck);
+		CompWriteBytes((uint32_t)TextureDecodedTexel, Out);
 
 		CompRes FinalResult;
 
@@ -4790,10 +5426,15 @@ void glDeleteShader(GLuint shader)
 typedef struct
 {
 	uint8_t Linked;
+	uint32_t LinkCount; // Set from GlobalLinkCount by every glLinkProgram, vertex arrays rebuild their fetch table when it changes
 	_Vector VertexFragInOut;
 	_Vector Uniforms;
 	_Vector Layouts;
 
+	// Built-ins of the vertex shader, looked up when the program is linked
+	glslVariable* PositionVar;
+	glslVariable* InstanceIDVar;
+
 	uint8_t HasVertex;
 	uint8_t HasFrag;
 	_Vector VertexShaderBin;
@@ -4803,15 +5444,38 @@ typedef struct
 } Program;
 
 Program* ActiveProgram;
-_Vector GlobalPrograms;
+HandleTable GlobalPrograms;
+
+// Counts links across all programs, so a program allocated where a deleted one was never matches its fetch tables
+uint32_t GlobalLinkCount;
 
 GLuint glCreateProgram()
 {
 	Program* NewProgram = (Program*)malloc(sizeof(Program));
 	NewProgram->VertexFragInOut = NewVector(sizeof(_VarPair));
+	NewProgram->Uniforms = NewVector(sizeof(glslVariable*));
+	NewProgram->Layouts = NewVector(sizeof(glslVariable*));
 	NewProgram->Linked = 0;
-	VectorPushBack(&GlobalPrograms, &NewProgram);
-	return GlobalPrograms.Size;
+	NewProgram->LinkCount = 0;
+	NewProgram->PositionVar = 0;
+	NewProgram->InstanceIDVar = 0;
+	return HandleAlloc(&GlobalPrograms, NewProgram);
+}
+
+// The shaders' compiled code stays with the shaders, only what glLinkProgram built is the program's own
+void glDeleteProgram(GLuint program)
+{
+	if (program == 0) return;
+
+	Program* MyProgram = (Program*)HandleFree(&GlobalPrograms, program);
+	if (!MyProgram) return;
+
+	if (ActiveProgram == MyProgram) ActiveProgram = 0;
+
+	free(MyProgram->VertexFragInOut.Data);
+	free(MyProgram->Uniforms.Data);
+	free(MyProgram->Layouts.Data);
+	free(MyProgram);
 }
 
 void glAttachShader(GLuint program, GLuint shader)
@@ -4819,7 +5483,8 @@ void glAttachShader(GLuint program, GLuint shader)
 	Program* MyProgram;
 	RawShader* MyShader;
 
-	VectorRead(&GlobalPrograms, &MyProgram, program - 1);
+	MyProgram = (Program*)HandleLookup(&GlobalPrograms, program);
+	if (!MyProgram) return;
 	VectorRead(&GlobalShaders, &MyShader, shader);
 
 	if (MyShader->Type == GL_VERTEX_SHADER)
@@ -4840,7 +5505,13 @@ void glLinkProgram(GLuint program)
 {
 	Program* MyProgram;
 
-	VectorRead(&GlobalPrograms, &MyProgram, program - 1);
+	MyProgram = (Program*)HandleLookup(&GlobalPrograms, program);
+	if (!MyProgram) return;
+
+	// Relinking starts over, the pairs and uniforms of the last link would otherwise be kept and added again
+	MyProgram->VertexFragInOut.Size = 0;
+	free(MyProgram->Uniforms.Data);
+	free(MyProgram->Layouts.Data);
 
 	_Vector VertOuts = NewVector(sizeof(glslVariable*));
 	_Vector FragIns = NewVector(sizeof(glslVariable*));
@@ -4848,6 +5519,8 @@ void glLinkProgram(GLuint program)
 	_Vector Uniforms = NewVector(sizeof(glslVariable*));
 	_Vector Layouts = NewVector(sizeof(glslVariable*));
 
+	MyProgram->PositionVar = 0;
+	MyProgram->InstanceIDVar = 0;
 
 	for (int i = 0; i < MyProgram->VertexShader.GlobalVars.Size; i++)
 	{
@@ -4858,6 +5531,9 @@ void glLinkProgram(GLuint program)
 		if (VertVar->isOut) VectorPushBack(&VertOuts, &VertVar);
 		if (VertVar->isUniform) VectorPushBack(&Uniforms, &VertVar);
 		if (VertVar->isLayout) VectorPushBack(&Layouts, &VertVar);
+
+		if (StringEquals(VertVar->Name, "gl_Position")) MyProgram->PositionVar = VertVar;
+		if (StringEquals(VertVar->Name, "gl_InstanceID")) MyProgram->InstanceIDVar = VertVar;
 	}
 
 	for (int i = 0; i < MyProgram->FragmentShader.GlobalVars.Size; i++)
@@ -4898,21 +5574,50 @@ void glLinkProgram(GLuint program)
 		}
 	}
 
+	free(VertOuts.Data);
+	free(FragIns.Data);
+
 	MyProgram->Linked = 1;
+	MyProgram->LinkCount = ++GlobalLinkCount;
 }
 
 void glUseProgram(GLuint program)
 {
 	if (program == 0) ActiveProgram = 0;
-	else VectorRead(&GlobalPrograms, &ActiveProgram, program - 1);
+	else ActiveProgram = (Program*)HandleLookup(&GlobalPrograms, program);
 }
 
 typedef struct
 {
 	void* data;
 	GLsizei size;
+	GLsizei capacity; // Bytes allocated for data, re-specifying reuses them while the new size fits
+	GLenum usage;
+	void* mapped; // Pointer handed out by glMapBufferRange, 0 while unmapped
+
+	// Vertex array attributes sourcing from the buffer keep it alive after glDeleteBuffers, like in GL
+	int References;
+	uint8_t Deleted;
 } Buffer;
 
+void BufferFree(Buffer* MyBuffer)
+{
+	if (MyBuffer->data) free(MyBuffer->data);
+	free(MyBuffer);
+}
+
+void BufferAddReference(Buffer* MyBuffer)
+{
+	if (MyBuffer) MyBuffer->References++;
+}
+
+void BufferRelease(Buffer* MyBuffer)
+{
+	if (!MyBuffer) return;
+	MyBuffer->References--;
+	if (MyBuffer->Deleted && MyBuffer->References == 0) BufferFree(MyBuffer);
+}
+
 typedef struct
 {
 	GLsizei stride;
@@ -4920,42 +5625,90 @@ typedef struct
 	GLenum type;
 	GLint size;
 	GLuint index;
+	GLuint divisor; // 0 advances per vertex, N advances once every N instances
 
 	int offset;
+	Buffer* buffer; // Array buffer bound when glVertexAttribPointer was called, its current contents are read at draw time
 } VertexArrayAttrib;
 
+// One attribute resolved against the layout variable it feeds, Dest is that variable's slot in the vertex shader's memory
 typedef struct
 {
-	_Vector Attribs;
-	Buffer* VertexBuffer;
-	Buffer* ElementBuffer;
-} VertexArray;
-
+	Buffer* buffer;
+	int offset;
+	GLsizei stride;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLuint divisor;
+	float* Dest;
+} VertexFetch;
+
+typedef struct
+{
+	_Vector Attribs;
+	Buffer* ElementBuffer;
+
+	// Attribute to layout bindings for FetchProgram, rebuilt when the program is relinked or an attribute changes
+	_Vector Fetches;
+	_Vector InstanceFetches; // Attributes with a divisor, loaded once per instance
+	Program* FetchProgram;
+	uint32_t FetchLinkCount;
+} VertexArray;
+
 VertexArray* ActiveVertexArray;
-_Vector GlobalVertexArrays;
+HandleTable GlobalVertexArrays;
+
+Buffer* GlobalArrayBuffer;
 
 GLuint glGenVertexArrays(GLsizei n, GLuint* arrays)
 {
-	// Only supports one vertex array per call for now
-	*arrays = GlobalVertexArrays.Size + 1;
-
-	VertexArray* VertArray = (VertexArray*)malloc(sizeof(VertexArray));
-	VertArray->Attribs = NewVector(sizeof(VertexArrayAttrib));
-	VertArray->ElementBuffer = (Buffer*)malloc(sizeof(Buffer));
-	VertArray->ElementBuffer->data = 0;
-	VertArray->ElementBuffer->size = 0;
-	VertArray->VertexBuffer = (Buffer*)malloc(sizeof(Buffer));
-	VertArray->VertexBuffer->data = 0;
-	VertArray->VertexBuffer->size = 0;
+	for (int i = 0; i < n; i++)
+	{
+		VertexArray* VertArray = (VertexArray*)malloc(sizeof(VertexArray));
+		VertArray->Attribs = NewVector(sizeof(VertexArrayAttrib));
+		VertArray->ElementBuffer = (Buffer*)malloc(sizeof(Buffer));
+		VertArray->ElementBuffer->data = 0;
+		VertArray->ElementBuffer->size = 0;
+		VertArray->Fetches = NewVector(sizeof(VertexFetch));
+		VertArray->InstanceFetches = NewVector(sizeof(VertexFetch));
+		VertArray->FetchProgram = 0;
 
-	VectorPushBack(&GlobalVertexArrays, &VertArray);
+		arrays[i] = HandleAlloc(&GlobalVertexArrays, VertArray);
+	}
 	return 0;
 }
 
+void glDeleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (arrays[i] == 0) continue;
+
+		VertexArray* VertArray = (VertexArray*)HandleFree(&GlobalVertexArrays, arrays[i]);
+		if (!VertArray) continue;
+
+		if (ActiveVertexArray == VertArray) ActiveVertexArray = 0;
+
+		for (int j = 0; j < VertArray->Attribs.Size; j++)
+		{
+			VertexArrayAttrib Attrib;
+			VectorRead(&VertArray->Attribs, &Attrib, j);
+			BufferRelease(Attrib.buffer);
+		}
+
+		free(VertArray->Attribs.Data);
+		free(VertArray->Fetches.Data);
+		free(VertArray->InstanceFetches.Data);
+		BufferFree(VertArray->ElementBuffer);
+		free(VertArray);
+	}
+}
+
 void glBindVertexArray(GLuint array)
 {
 	if (array == 0) ActiveVertexArray = 0;
-	else VectorRead(&GlobalVertexArrays, &ActiveVertexArray, array - 1);
+	else ActiveVertexArray = (VertexArray*)HandleLookup(&GlobalVertexArrays, array);
 }
 
 void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer)
@@ -4970,28 +5723,101 @@ void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean norm
 		Attrib.size = size;
 		Attrib.stride = stride;
 		Attrib.type = type;
+		Attrib.buffer = GlobalArrayBuffer;
+		Attrib.divisor = 0;
+
+		BufferAddReference(Attrib.buffer);
+
+		ActiveVertexArray->FetchProgram = 0; // Fetch table is stale
+
+		// Respecifying an attribute replaces it, the divisor is separate state and is kept
+		for (int i = 0; i < ActiveVertexArray->Attribs.Size; i++)
+		{
+			VertexArrayAttrib Existing;
+			VectorRead(&ActiveVertexArray->Attribs, &Existing, i);
+			if (Existing.index == index)
+			{
+				BufferRelease(Existing.buffer);
+				Attrib.divisor = Existing.divisor;
+				VectorWrite(&ActiveVertexArray->Attribs, &Attrib, i);
+				return;
+			}
+		}
 
 		VectorPushBack(&ActiveVertexArray->Attribs, &Attrib);
 	}
 }
 
-_Vector GlobalBuffers;
+void glVertexAttribDivisor(GLuint index, GLuint divisor)
+{
+	if (ActiveVertexArray)
+	{
+		ActiveVertexArray->FetchProgram = 0; // Fetch table is stale
+
+		for (int i = 0; i < ActiveVertexArray->Attribs.Size; i++)
+		{
+			VertexArrayAttrib Existing;
+			VectorRead(&ActiveVertexArray->Attribs, &Existing, i);
+			if (Existing.index == index)
+			{
+				Existing.divisor = divisor;
+				VectorWrite(&ActiveVertexArray->Attribs, &Existing, i);
+				return;
+			}
+		}
+
+		// Set before the pointer, keep the divisor until glVertexAttribPointer fills the attribute in
+		VertexArrayAttrib Attrib;
+		Attrib.index = index;
+		Attrib.normalized = GL_FALSE;
+		Attrib.offset = 0;
+		Attrib.size = 0;
+		Attrib.stride = 0;
+		Attrib.type = GL_FLOAT;
+		Attrib.buffer = 0;
+		Attrib.divisor = divisor;
+
+		VectorPushBack(&ActiveVertexArray->Attribs, &Attrib);
+	}
+}
+
+HandleTable GlobalBuffers;
 
 GLuint glGenBuffers(GLsizei n, GLuint* buffers)
 {
-	// Only supports 1 buffer per call for now
-	*buffers = GlobalBuffers.Size + 1;
-
-	Buffer* NewBuffer = (Buffer*)malloc(sizeof(Buffer));
+	for (int i = 0; i < n; i++)
+	{
+		Buffer* NewBuffer = (Buffer*)malloc(sizeof(Buffer));
 
-	NewBuffer->data = 0;
-	NewBuffer->size = 0;
+		NewBuffer->data = 0;
+		NewBuffer->size = 0;
+		NewBuffer->capacity = 0;
+		NewBuffer->usage = GL_STATIC_DRAW;
+		NewBuffer->mapped = 0;
+		NewBuffer->References = 0;
+		NewBuffer->Deleted = 0;
 
-	VectorPushBack(&GlobalBuffers, &NewBuffer);
+		buffers[i] = HandleAlloc(&GlobalBuffers, NewBuffer);
+	}
 	return 0;
 }
 
-Buffer* GlobalArrayBuffer;
+// The name is gone right away, the storage only once no vertex array attribute uses it anymore
+void glDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (buffers[i] == 0) continue;
+
+		Buffer* MyBuffer = (Buffer*)HandleFree(&GlobalBuffers, buffers[i]);
+		if (!MyBuffer) continue;
+
+		if (GlobalArrayBuffer == MyBuffer) GlobalArrayBuffer = 0;
+
+		MyBuffer->Deleted = 1;
+		if (MyBuffer->References == 0) BufferFree(MyBuffer);
+	}
+}
 
 void glBindBuffer(GLenum type, GLuint buffer)
 {
@@ -5003,43 +5829,75 @@ void glBindBuffer(GLenum type, GLuint buffer)
 			return;
 		}
 
-		Buffer* TargetBuffer;
-
-		VectorRead(&GlobalBuffers, &TargetBuffer, buffer - 1);
-
-		if (ActiveVertexArray)
-		{
-			GlobalArrayBuffer = ActiveVertexArray->VertexBuffer;
-
-			GlobalArrayBuffer->data = TargetBuffer->data;
-			GlobalArrayBuffer->size = TargetBuffer->size;
-		}
-		else
-		{
-			GlobalArrayBuffer = TargetBuffer;
-		}
+		GlobalArrayBuffer = (Buffer*)HandleLookup(&GlobalBuffers, buffer);
 	}
 }
-void glBufferData(GLenum target, GLsizei size, const void* data, GLenum usage)
+
+Buffer* BufferForTarget(GLenum target)
 {
-	Buffer* MyBuffer = 0;
+	if (target == GL_ARRAY_BUFFER) return GlobalArrayBuffer;
+	return 0;
+}
 
-	if (target == GL_ARRAY_BUFFER)
-	{
-		MyBuffer = GlobalArrayBuffer;
-	}
+/*
+* Draws are finished by the time glDrawArrays returns, so nothing ever reads a buffer behind the client's back.
+* Orphaning the old contents therefore doesn't need fresh storage: it's reused whenever the new size fits,
+* and mapping never has to wait, which makes GL_MAP_UNSYNCHRONIZED_BIT the only behaviour there is.
+*/
+void glBufferData(GLenum target, GLsizei size, const void* data, GLenum usage)
+{
+	Buffer* MyBuffer = BufferForTarget(target);
 
 	if (MyBuffer)
 	{
-		if (MyBuffer->size == 0)
+		MyBuffer->mapped = 0; // Re-specifying a buffer unmaps it
+		if (MyBuffer->capacity < size)
 		{
+			if (MyBuffer->data) free(MyBuffer->data);
 			MyBuffer->data = malloc(size);
-			MyBuffer->size = size;
-			memcpy(MyBuffer->data, data, size);
+			MyBuffer->capacity = size;
 		}
+		MyBuffer->size = size;
+		MyBuffer->usage = usage;
+		if (data) memcpy(MyBuffer->data, data, size);
 	}
 }
 
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	Buffer* MyBuffer = BufferForTarget(target);
+
+	if (!MyBuffer || !data) return;
+	if (offset < 0 || offset + size > MyBuffer->size) return;
+
+	memcpy((uint8_t*)MyBuffer->data + offset, data, size);
+}
+
+void* glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLuint access)
+{
+	Buffer* MyBuffer = BufferForTarget(target);
+
+	if (!MyBuffer || MyBuffer->mapped) return 0;
+	if (offset < 0 || offset + length > MyBuffer->size) return 0;
+	if (!(access & (GL_MAP_READ_BIT | GL_MAP_WRITE_BIT))) return 0;
+	// By specification, invalidated or unsynchronized contents can't be read back
+	if ((access & GL_MAP_READ_BIT) && (access & (GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT))) return 0;
+
+	// Invalidated ranges are undefined, so handing out the current storage as is is correct
+	MyBuffer->mapped = (uint8_t*)MyBuffer->data + offset;
+	return MyBuffer->mapped;
+}
+
+GLboolean glUnmapBuffer(GLenum target)
+{
+	Buffer* MyBuffer = BufferForTarget(target);
+
+	if (!MyBuffer || !MyBuffer->mapped) return GL_FALSE;
+
+	MyBuffer->mapped = 0;
+	return GL_TRUE;
+}
+
 
 
 GLint ViewportX;
@@ -5047,19 +5905,514 @@ GLint ViewportY;
 GLsizei ViewportWidth;
 GLsizei ViewportHeight;
 
+// Display to framebuffer factor for viewports and damage given while the framebuffer made by glInit is bound
+GLfloat ViewportScale;
+
 typedef struct
 {
 	GLsizei Width;
 	GLsizei Height;
 
 	GLenum ColorFormat;
-	uint32_t* ColorAttachment;
+	void* ColorAttachment;
 
 	GLenum DepthFormat;
 	void* DepthAttachment;
+
+	// One byte per GL_DAMAGE_TILE_SIZE square of the color attachment. DamageTiles are the tiles written
+	// since the last glResetDamage, ClearedTiles the ones holding nothing but ClearedColor.
+	GLsizei TilesX;
+	GLsizei TilesY;
+	uint8_t* DamageTiles;
+	uint8_t* ClearedTiles;
+	uint32_t ClearedColor;
+
+	// Clears glClear only recorded for a tile, FRAMEBUFFER_PENDING_* bits, and the packed values to fill it with
+	uint8_t* PendingTiles;
+	uint32_t* PendingColors;
+	uint32_t* PendingDepths;
+
+	// What a framebuffer object has attached, its attachment pointers and size follow them in FramebufferSync
+	Texture2D* ColorTexture;
+	struct _Renderbuffer* DepthRenderbuffer;
 } Framebuffer;
 
-Framebuffer* GlobalFramebuffer;
+typedef struct _Renderbuffer
+{
+	GLenum Format;
+	GLsizei Width;
+	GLsizei Height;
+	void* Data;
+} Renderbuffer;
+
+#define FRAMEBUFFER_PENDING_COLOR 1
+#define FRAMEBUFFER_PENDING_DEPTH 2
+
+Framebuffer* GlobalFramebuffer; // The one being drawn to
+Framebuffer* DefaultFramebuffer; // The one glInit made, presented through glGetFramePtr
+
+HandleTable GlobalFramebuffers;
+HandleTable GlobalRenderbuffers;
+Renderbuffer* ActiveRenderbuffer;
+
+GLboolean DepthTestEnabled;
+GLboolean DepthWriteEnabled;
+GLenum DepthFunc;
+GLfloat ClearDepthValue;
+
+// Bytes per depth value. GL_DEPTH_COMPONENT is a 32-bit float, 24-bit depth takes a whole word.
+int DepthFormatBytes(GLenum Format)
+{
+	return Format == GL_DEPTH_COMPONENT16 ? 2 : 4;
+}
+
+/*
+* Stored form of a window depth in [0, 1]. Integer formats scale it to their range, the float format keeps
+* its bits: positive floats order the same way as their bit patterns, so every format compares as integers.
+*/
+uint32_t DepthPack(GLenum Format, float Depth)
+{
+	Depth = MIN(MAX(Depth, 0.0f), 1.0f);
+	if (Format == GL_DEPTH_COMPONENT16) return (uint32_t)(Depth * 65535.0f + 0.5f);
+	if (Format == GL_DEPTH_COMPONENT24) return (uint32_t)(Depth * 16777215.0f + 0.5f);
+	return *(uint32_t*)&Depth;
+}
+
+// Packs a color with components in [0, 1] the way ColorFormat stores it
+uint32_t FramebufferPackColor(float R, float G, float B, float A)
+{
+	uint32_t Red = MIN(MAX(R, 0.0f), 1.0f) * 255;
+	uint32_t Green = MIN(MAX(G, 0.0f), 1.0f) * 255;
+	uint32_t Blue = MIN(MAX(B, 0.0f), 1.0f) * 255;
+	uint32_t Alpha = MIN(MAX(A, 0.0f), 1.0f) * 255;
+
+	if (GlobalFramebuffer->ColorFormat == GL_BGRA) return (Alpha << 24) | (Red << 16) | (Green << 8) | Blue;
+	if (GlobalFramebuffer->ColorFormat == GL_RGB565) return ((Red >> 3) << 11) | ((Green >> 2) << 5) | (Blue >> 3);
+	if (GlobalFramebuffer->ColorFormat == GL_RGB) return (Red << 24) | (Green << 16) | (Blue << 8) | 0xFF;
+	return (Red << 24) | (Green << 16) | (Blue << 8) | Alpha;
+}
+
+// The other way around, RGB565 has no alpha and reads back opaque
+void FramebufferUnpackColor(uint32_t Color, float* R, float* G, float* B, float* A)
+{
+	if (GlobalFramebuffer->ColorFormat == GL_BGRA)
+	{
+		*R = ((Color >> 16) & 0xFF) / 255.0f;
+		*G = ((Color >> 8) & 0xFF) / 255.0f;
+		*B = (Color & 0xFF) / 255.0f;
+		*A = (Color >> 24) / 255.0f;
+	}
+	else if (GlobalFramebuffer->ColorFormat == GL_RGB565)
+	{
+		*R = ((Color >> 11) & 0x1F) / 31.0f;
+		*G = ((Color >> 5) & 0x3F) / 63.0f;
+		*B = (Color & 0x1F) / 31.0f;
+		*A = 1.0f;
+	}
+	else
+	{
+		*R = (Color >> 24) / 255.0f;
+		*G = ((Color >> 16) & 0xFF) / 255.0f;
+		*B = ((Color >> 8) & 0xFF) / 255.0f;
+		*A = (Color & 0xFF) / 255.0f;
+	}
+}
+
+// Color of pixel (x, y) of the color attachment, components in [0, 1]. A texture attachment has
+// ColorFormat GL_TEXTURE_2D and keeps its float texels.
+void FramebufferRead(int x, int y, float* R, float* G, float* B, float* A)
+{
+	if (GlobalFramebuffer->ColorFormat == GL_TEXTURE_2D)
+	{
+		float* Texel = TextureLevelTexel((float*)GlobalFramebuffer->ColorAttachment, x, y);
+		*R = Texel[0];
+		*G = Texel[1];
+		*B = Texel[2];
+		*A = Texel[3];
+		return;
+	}
+
+	int i = y * GlobalFramebuffer->Width + x;
+	if (GlobalFramebuffer->ColorFormat == GL_RGB565) FramebufferUnpackColor(((uint16_t*)GlobalFramebuffer->ColorAttachment)[i], R, G, B, A);
+	else FramebufferUnpackColor(((uint32_t*)GlobalFramebuffer->ColorAttachment)[i], R, G, B, A);
+}
+
+void FramebufferWrite(int x, int y, float R, float G, float B, float A)
+{
+	if (GlobalFramebuffer->ColorFormat == GL_TEXTURE_2D)
+	{
+		__m128 Color = _mm_min_ps(_mm_max_ps(_mm_setr_ps(R, G, B, A), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		_mm_storeu_ps(TextureLevelTexel((float*)GlobalFramebuffer->ColorAttachment, x, y), Color);
+		return;
+	}
+
+	int i = y * GlobalFramebuffer->Width + x;
+	if (GlobalFramebuffer->ColorFormat == GL_RGB565) ((uint16_t*)GlobalFramebuffer->ColorAttachment)[i] = FramebufferPackColor(R, G, B, A);
+	else ((uint32_t*)GlobalFramebuffer->ColorAttachment)[i] = FramebufferPackColor(R, G, B, A);
+}
+
+// Points a framebuffer object at the current storage of what it has attached, glTexImage2D and
+// glRenderbufferStorage reallocate it. Attachments of different sizes leave the depth out.
+void FramebufferSync(Framebuffer* Target)
+{
+	if (Target == DefaultFramebuffer) return;
+
+	Texture2D* Texture = Target->ColorTexture;
+	Renderbuffer* Depth = Target->DepthRenderbuffer;
+
+	Target->ColorAttachment = 0;
+	Target->DepthAttachment = 0;
+	Target->Width = 0;
+	Target->Height = 0;
+
+	if (Texture && Texture->Data && !Texture->CompressedFormat)
+	{
+		Target->ColorAttachment = Texture->Data;
+		Target->Width = Texture->Width;
+		Target->Height = Texture->Height;
+	}
+
+	if (Depth && Depth->Data)
+	{
+		if (Target->ColorAttachment && (Depth->Width != Target->Width || Depth->Height != Target->Height)) return;
+
+		Target->DepthFormat = Depth->Format;
+		Target->DepthAttachment = Depth->Data;
+		Target->Width = Depth->Width;
+		Target->Height = Depth->Height;
+	}
+}
+
+// Detaches a texture being deleted from every framebuffer object
+void FramebufferDetachTexture(Texture2D* Texture)
+{
+	for (int i = 0; i < GlobalFramebuffers.Slots.Size; i++)
+	{
+		Framebuffer* Target = (Framebuffer*)HandleSlotObject(&GlobalFramebuffers, i);
+		if (!Target || Target->ColorTexture != Texture) continue;
+		Target->ColorTexture = 0;
+		FramebufferSync(Target);
+	}
+}
+
+// Stores Value to Count pixels of Bytes each (2 or 4), 16 bytes at a time
+void FramebufferFillRow(void* Dst, int Count, uint32_t Value, int Bytes)
+{
+	uint8_t* Out = (uint8_t*)Dst;
+	int Size = Count * Bytes;
+	__m128i Fill = Bytes == 2 ? _mm_set1_epi16(Value) : _mm_set1_epi32(Value);
+
+	int i = 0;
+	for (; i + 16 <= Size; i += 16) _mm_storeu_si128((__m128i*)(Out + i), Fill);
+	for (; i < Size; i += Bytes)
+	{
+		if (Bytes == 2) *(uint16_t*)(Out + i) = Value;
+		else *(uint32_t*)(Out + i) = Value;
+	}
+}
+
+// Fills rows [Y0, Y1) of columns [X0, X1) of a packed color attachment
+void FramebufferFillColor(Framebuffer* Target, int X0, int Y0, int X1, int Y1, uint32_t Color)
+{
+	int Bytes = Target->ColorFormat == GL_RGB565 ? 2 : 4;
+	for (int y = Y0; y < Y1; y++)
+	{
+		FramebufferFillRow((uint8_t*)Target->ColorAttachment + (y * Target->Width + X0) * Bytes, X1 - X0, Color, Bytes);
+	}
+}
+
+// Same for the depth attachment with a packed depth
+void FramebufferFillDepth(Framebuffer* Target, int X0, int Y0, int X1, int Y1, uint32_t Depth)
+{
+	int Bytes = DepthFormatBytes(Target->DepthFormat);
+	for (int y = Y0; y < Y1; y++)
+	{
+		FramebufferFillRow((uint8_t*)Target->DepthAttachment + (y * Target->Width + X0) * Bytes, X1 - X0, Depth, Bytes);
+	}
+}
+
+// Carries out the clears recorded for a tile
+void FramebufferResolveTile(Framebuffer* Target, int Tile)
+{
+	int X0 = (Tile % Target->TilesX) * GL_DAMAGE_TILE_SIZE;
+	int Y0 = (Tile / Target->TilesX) * GL_DAMAGE_TILE_SIZE;
+	int X1 = MIN(X0 + (int)GL_DAMAGE_TILE_SIZE, Target->Width);
+	int Y1 = MIN(Y0 + (int)GL_DAMAGE_TILE_SIZE, Target->Height);
+
+	if (Target->PendingTiles[Tile] & FRAMEBUFFER_PENDING_COLOR) FramebufferFillColor(Target, X0, Y0, X1, Y1, Target->PendingColors[Tile]);
+	if (Target->PendingTiles[Tile] & FRAMEBUFFER_PENDING_DEPTH) FramebufferFillDepth(Target, X0, Y0, X1, Y1, Target->PendingDepths[Tile]);
+	Target->PendingTiles[Tile] = 0;
+}
+
+// Called before a fragment reads or writes pixel (x, y) of the bound framebuffer
+void FramebufferTouch(int x, int y)
+{
+	if (!GlobalFramebuffer->PendingTiles) return;
+
+	int Tile = (y / GL_DAMAGE_TILE_SIZE) * GlobalFramebuffer->TilesX + x / GL_DAMAGE_TILE_SIZE;
+	if (GlobalFramebuffer->PendingTiles[Tile]) FramebufferResolveTile(GlobalFramebuffer, Tile);
+}
+
+// Depth test of pixel (x, y) against a window depth, the depth is stored when it passes and writes are on
+uint8_t FramebufferDepthTest(int x, int y, float Depth)
+{
+	int i = y * GlobalFramebuffer->Width + x;
+	uint32_t New = DepthPack(GlobalFramebuffer->DepthFormat, Depth);
+	uint32_t Cur;
+	if (GlobalFramebuffer->DepthFormat == GL_DEPTH_COMPONENT16) Cur = ((uint16_t*)GlobalFramebuffer->DepthAttachment)[i];
+	else Cur = ((uint32_t*)GlobalFramebuffer->DepthAttachment)[i];
+
+	uint8_t Pass = 0;
+	if (DepthFunc == GL_LESS) Pass = New < Cur;
+	else if (DepthFunc == GL_LEQUAL) Pass = New <= Cur;
+	else if (DepthFunc == GL_GREATER) Pass = New > Cur;
+	else if (DepthFunc == GL_GEQUAL) Pass = New >= Cur;
+	else if (DepthFunc == GL_EQUAL) Pass = New == Cur;
+	else if (DepthFunc == GL_NOTEQUAL) Pass = New != Cur;
+	else if (DepthFunc == GL_ALWAYS) Pass = 1;
+
+	if (Pass && DepthWriteEnabled)
+	{
+		if (GlobalFramebuffer->DepthFormat == GL_DEPTH_COMPONENT16) ((uint16_t*)GlobalFramebuffer->DepthAttachment)[i] = New;
+		else ((uint32_t*)GlobalFramebuffer->DepthAttachment)[i] = New;
+	}
+	return Pass;
+}
+
+// Marks the framebuffer rows [Y0, Y1) of columns [X0, X1) as written
+void FramebufferDamage(int X0, int Y0, int X1, int Y1)
+{
+	if (!GlobalFramebuffer->DamageTiles) return; // Only the default framebuffer is presented
+	X0 = MAX(X0, 0) / GL_DAMAGE_TILE_SIZE;
+	Y0 = MAX(Y0, 0) / GL_DAMAGE_TILE_SIZE;
+	X1 = MIN(X1, GlobalFramebuffer->Width);
+	Y1 = MIN(Y1, GlobalFramebuffer->Height);
+	if (X1 <= 0 || Y1 <= 0) return;
+	X1 = (X1 + GL_DAMAGE_TILE_SIZE - 1) / GL_DAMAGE_TILE_SIZE;
+	Y1 = (Y1 + GL_DAMAGE_TILE_SIZE - 1) / GL_DAMAGE_TILE_SIZE;
+
+	for (int y = Y0; y < Y1; y++)
+	{
+		for (int x = X0; x < X1; x++)
+		{
+			GlobalFramebuffer->DamageTiles[y * GlobalFramebuffer->TilesX + x] = 1;
+			GlobalFramebuffer->ClearedTiles[y * GlobalFramebuffer->TilesX + x] = 0;
+		}
+	}
+}
+
+// Same for a window space rectangle of the viewport, ShadeFragment stores GL row y upside down.
+// The bounds are inclusive, a horizontal or vertical line has min equal to max on one axis.
+void FramebufferDamageWindow(float minX, float minY, float maxX, float maxY)
+{
+	if (minX > maxX || minY > maxY) return;
+
+	int Flip = ViewportHeight + 2 * ViewportY - 1;
+	FramebufferDamage((int)minX, Flip - (int)maxY, (int)maxX + 1, Flip - (int)minY + 1);
+}
+
+void glAddDamage(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (GlobalFramebuffer != DefaultFramebuffer)
+	{
+		FramebufferDamage(x, y, x + width, y + height);
+		return;
+	}
+
+	// Rounded outwards, a pixel the scaled rectangle only partly covers is still damaged
+	float X1 = (x + width) * ViewportScale;
+	float Y1 = (y + height) * ViewportScale;
+	FramebufferDamage((int)(x * ViewportScale), (int)(y * ViewportScale), (int)X1 + (X1 > (int)X1), (int)Y1 + (Y1 > (int)Y1));
+}
+
+const uint8_t* glGetDamageTiles(GLsizei* TilesX, GLsizei* TilesY)
+{
+	// Whoever asks is about to read the damaged tiles, so their recorded clears can't wait any longer
+	for (int i = 0; i < DefaultFramebuffer->TilesX * DefaultFramebuffer->TilesY; i++)
+	{
+		if (DefaultFramebuffer->DamageTiles[i] && DefaultFramebuffer->PendingTiles[i]) FramebufferResolveTile(DefaultFramebuffer, i);
+	}
+
+	*TilesX = DefaultFramebuffer->TilesX;
+	*TilesY = DefaultFramebuffer->TilesY;
+	return DefaultFramebuffer->DamageTiles;
+}
+
+void glResetDamage()
+{
+	memset(DefaultFramebuffer->DamageTiles, 0, DefaultFramebuffer->TilesX * DefaultFramebuffer->TilesY);
+}
+
+void glGenFramebuffers(GLsizei n, GLuint* framebuffers)
+{
+	for (int i = 0; i < n; i++)
+	{
+		Framebuffer* NewFramebuffer = (Framebuffer*)malloc(sizeof(Framebuffer));
+		NewFramebuffer->Width = 0;
+		NewFramebuffer->Height = 0;
+		NewFramebuffer->ColorFormat = GL_TEXTURE_2D;
+		NewFramebuffer->ColorAttachment = 0;
+		NewFramebuffer->DepthFormat = GL_DEPTH_COMPONENT;
+		NewFramebuffer->DepthAttachment = 0;
+		NewFramebuffer->TilesX = 0;
+		NewFramebuffer->TilesY = 0;
+		NewFramebuffer->DamageTiles = 0;
+		NewFramebuffer->ClearedTiles = 0;
+		NewFramebuffer->ClearedColor = 0;
+		NewFramebuffer->PendingTiles = 0;
+		NewFramebuffer->PendingColors = 0;
+		NewFramebuffer->PendingDepths = 0;
+		NewFramebuffer->ColorTexture = 0;
+		NewFramebuffer->DepthRenderbuffer = 0;
+		framebuffers[i] = HandleAlloc(&GlobalFramebuffers, NewFramebuffer);
+	}
+}
+
+// Deleting the bound framebuffer object goes back to drawing to the default one
+void glDeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (framebuffers[i] == 0) continue;
+
+		Framebuffer* Target = (Framebuffer*)HandleFree(&GlobalFramebuffers, framebuffers[i]);
+		if (!Target) continue;
+
+		if (GlobalFramebuffer == Target) GlobalFramebuffer = DefaultFramebuffer;
+		free(Target);
+	}
+}
+
+void glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	if (target != GL_FRAMEBUFFER) return;
+
+	if (framebuffer == 0)
+	{
+		GlobalFramebuffer = DefaultFramebuffer;
+		return;
+	}
+
+	Framebuffer* Target = (Framebuffer*)HandleLookup(&GlobalFramebuffers, framebuffer);
+	if (!Target) return;
+
+	GlobalFramebuffer = Target;
+	FramebufferSync(Target);
+}
+
+// Only level 0 can be rendered to, glGenerateMipmap rebuilds the rest afterwards
+void glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
+{
+	if (target != GL_FRAMEBUFFER || attachment != GL_COLOR_ATTACHMENT0) return;
+	if (GlobalFramebuffer == DefaultFramebuffer) return;
+	if (texture != 0 && (textarget != GL_TEXTURE_2D || level != 0)) return;
+
+	Texture2D* Texture = 0;
+	if (texture != 0)
+	{
+		Texture = (Texture2D*)HandleLookup(&GlobalTextures, texture);
+		if (!Texture) return;
+	}
+
+	GlobalFramebuffer->ColorTexture = Texture;
+	FramebufferSync(GlobalFramebuffer);
+}
+
+void glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer)
+{
+	if (target != GL_FRAMEBUFFER || attachment != GL_DEPTH_ATTACHMENT) return;
+	if (GlobalFramebuffer == DefaultFramebuffer) return;
+	if (renderbuffer != 0 && renderbuffertarget != GL_RENDERBUFFER) return;
+
+	Renderbuffer* Depth = 0;
+	if (renderbuffer != 0)
+	{
+		Depth = (Renderbuffer*)HandleLookup(&GlobalRenderbuffers, renderbuffer);
+		if (!Depth) return;
+	}
+
+	GlobalFramebuffer->DepthRenderbuffer = Depth;
+	FramebufferSync(GlobalFramebuffer);
+}
+
+GLenum glCheckFramebufferStatus(GLenum target)
+{
+	if (target != GL_FRAMEBUFFER) return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
+	if (GlobalFramebuffer == DefaultFramebuffer) return GL_FRAMEBUFFER_COMPLETE;
+
+	FramebufferSync(GlobalFramebuffer);
+
+	Texture2D* Texture = GlobalFramebuffer->ColorTexture;
+	Renderbuffer* Depth = GlobalFramebuffer->DepthRenderbuffer;
+	if (!Texture && !Depth) return GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT;
+	if (Texture && !GlobalFramebuffer->ColorAttachment) return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
+	if (Depth && !GlobalFramebuffer->DepthAttachment) return GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT;
+	return GL_FRAMEBUFFER_COMPLETE;
+}
+
+void glGenRenderbuffers(GLsizei n, GLuint* renderbuffers)
+{
+	for (int i = 0; i < n; i++)
+	{
+		Renderbuffer* NewRenderbuffer = (Renderbuffer*)malloc(sizeof(Renderbuffer));
+		NewRenderbuffer->Format = GL_DEPTH_COMPONENT;
+		NewRenderbuffer->Width = 0;
+		NewRenderbuffer->Height = 0;
+		NewRenderbuffer->Data = 0;
+		renderbuffers[i] = HandleAlloc(&GlobalRenderbuffers, NewRenderbuffer);
+	}
+}
+
+// Deleting a renderbuffer detaches it from every framebuffer object
+void glDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (renderbuffers[i] == 0) continue;
+
+		Renderbuffer* Depth = (Renderbuffer*)HandleFree(&GlobalRenderbuffers, renderbuffers[i]);
+		if (!Depth) continue;
+
+		for (int j = 0; j < GlobalFramebuffers.Slots.Size; j++)
+		{
+			Framebuffer* Target = (Framebuffer*)HandleSlotObject(&GlobalFramebuffers, j);
+			if (!Target || Target->DepthRenderbuffer != Depth) continue;
+			Target->DepthRenderbuffer = 0;
+			FramebufferSync(Target);
+		}
+
+		if (ActiveRenderbuffer == Depth) ActiveRenderbuffer = 0;
+		if (Depth->Data) free(Depth->Data);
+		free(Depth);
+	}
+}
+
+void glBindRenderbuffer(GLenum target, GLuint renderbuffer)
+{
+	if (target != GL_RENDERBUFFER) return;
+
+	if (renderbuffer == 0)
+	{
+		ActiveRenderbuffer = 0;
+		return;
+	}
+
+	Renderbuffer* Depth = (Renderbuffer*)HandleLookup(&GlobalRenderbuffers, renderbuffer);
+	if (Depth) ActiveRenderbuffer = Depth;
+}
+
+// Renderbuffers only hold depth, the contents are undefined until the first clear
+void glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	if (target != GL_RENDERBUFFER || !ActiveRenderbuffer) return;
+	if (internalformat != GL_DEPTH_COMPONENT && internalformat != GL_DEPTH_COMPONENT16 && internalformat != GL_DEPTH_COMPONENT24) return;
+
+	if (ActiveRenderbuffer->Data) free(ActiveRenderbuffer->Data);
+	ActiveRenderbuffer->Format = internalformat;
+	ActiveRenderbuffer->Width = width;
+	ActiveRenderbuffer->Height = height;
+	ActiveRenderbuffer->Data = malloc(DepthFormatBytes(internalformat) * width * height);
+}
 
 GLfloat ClearColorRed;
 GLfloat ClearColorGreen;
@@ -5076,45 +6429,164 @@ void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
 
 void glClear(GLuint flags)
 {
-	if (flags & GL_COLOR_BUFFER_BIT)
-	{
-		uint32_t ClearColor = 0;
-		ClearColor |= (uint32_t)(ClearColorRed * 255) << 24;
-		ClearColor |= (uint32_t)(ClearColorGreen * 255) << 16;
-		ClearColor |= (uint32_t)(ClearColorBlue * 255) << 8;
-		ClearColor |= (uint32_t)(ClearColorAlpha * 255);
+	FramebufferSync(GlobalFramebuffer);
+
+	int X0 = MAX(ViewportX, 0);
+	int Y0 = MAX(ViewportY, 0);
+	int X1 = MIN(ViewportX + ViewportWidth, GlobalFramebuffer->Width);
+	int Y1 = MIN(ViewportY + ViewportHeight, GlobalFramebuffer->Height);
+	if (X0 >= X1 || Y0 >= Y1) return;
 
-		for (int y = MAX(ViewportY, 0); y < MIN(ViewportY + ViewportHeight, GlobalFramebuffer->Height); y++)
+	uint8_t Color = (flags & GL_COLOR_BUFFER_BIT) && GlobalFramebuffer->ColorAttachment;
+	uint8_t Depth = (flags & GL_DEPTH_BUFFER_BIT) && GlobalFramebuffer->DepthAttachment && DepthWriteEnabled;
+	uint32_t ClearColor = FramebufferPackColor(ClearColorRed, ClearColorGreen, ClearColorBlue, ClearColorAlpha);
+	uint32_t ClearDepth = DepthPack(GlobalFramebuffer->DepthFormat, ClearDepthValue);
+
+	// Framebuffer objects have no tiles and are filled right away
+	if (!GlobalFramebuffer->PendingTiles)
+	{
+		if (Color && GlobalFramebuffer->ColorFormat == GL_TEXTURE_2D)
 		{
-			for (int x = MAX(ViewportX, 0); x < MIN(ViewportX + ViewportWidth, GlobalFramebuffer->Width); x++)
+			__m128 Texel = _mm_setr_ps(ClearColorRed, ClearColorGreen, ClearColorBlue, ClearColorAlpha);
+			for (int y = Y0; y < Y1; y++)
 			{
-				GlobalFramebuffer->ColorAttachment[y * GlobalFramebuffer->Width + x] = ClearColor;
+				for (int x = X0; x < X1; x++) _mm_storeu_ps(TextureLevelTexel((float*)GlobalFramebuffer->ColorAttachment, x, y), Texel);
 			}
 		}
+		else if (Color) FramebufferFillColor(GlobalFramebuffer, X0, Y0, X1, Y1, ClearColor);
+
+		if (Depth) FramebufferFillDepth(GlobalFramebuffer, X0, Y0, X1, Y1, ClearDepth);
+		return;
 	}
-	if (flags & GL_DEPTH_BUFFER_BIT)
+
+	/*
+	* Tiles the clear covers completely only record it, they're filled when a fragment first touches them or
+	* present reads them. Tiles it covers in part are filled now. Tiles already holding only this color didn't
+	* change, the others are damaged, and the covered ones hold only ClearColor from now on.
+	*/
+	int Size = GL_DAMAGE_TILE_SIZE;
+	uint8_t SameColor = ClearColor == GlobalFramebuffer->ClearedColor;
+	for (int ty = 0; ty < GlobalFramebuffer->TilesY; ty++)
 	{
-		if (GlobalFramebuffer->DepthFormat == GL_FLOAT)
+		for (int tx = 0; tx < GlobalFramebuffer->TilesX; tx++)
 		{
-			for (int y = MAX(ViewportY, 0); y < MIN(ViewportY + ViewportHeight, GlobalFramebuffer->Height); y++)
+			int i = ty * GlobalFramebuffer->TilesX + tx;
+			int TileX1 = MIN((tx + 1) * Size, GlobalFramebuffer->Width);
+			int TileY1 = MIN((ty + 1) * Size, GlobalFramebuffer->Height);
+
+			uint8_t Touched = tx * Size < X1 && TileX1 > X0 && ty * Size < Y1 && TileY1 > Y0;
+			uint8_t Covered = tx * Size >= X0 && TileX1 <= X1 && ty * Size >= Y0 && TileY1 <= Y1;
+
+			if (Color && !SameColor && !Covered) GlobalFramebuffer->ClearedTiles[i] = 0;
+			if (!Touched) continue;
+
+			uint8_t Changes = Color && !(SameColor && GlobalFramebuffer->ClearedTiles[i]);
+			if (Changes) GlobalFramebuffer->DamageTiles[i] = 1;
+
+			if (Covered)
 			{
-				for (int x = MAX(ViewportX, 0); x < MIN(ViewportX + ViewportWidth, GlobalFramebuffer->Width); x++)
+				if (Changes)
 				{
-					((GLfloat*)GlobalFramebuffer->DepthAttachment)[y * GlobalFramebuffer->Width + x] = 0.0f;
+					GlobalFramebuffer->PendingTiles[i] |= FRAMEBUFFER_PENDING_COLOR;
+					GlobalFramebuffer->PendingColors[i] = ClearColor;
 				}
+				if (Color) GlobalFramebuffer->ClearedTiles[i] = 1;
+				if (Depth)
+				{
+					GlobalFramebuffer->PendingTiles[i] |= FRAMEBUFFER_PENDING_DEPTH;
+					GlobalFramebuffer->PendingDepths[i] = ClearDepth;
+				}
+				continue;
 			}
+
+			if (GlobalFramebuffer->PendingTiles[i]) FramebufferResolveTile(GlobalFramebuffer, i);
+
+			int FillX0 = MAX(tx * Size, X0);
+			int FillY0 = MAX(ty * Size, Y0);
+			int FillX1 = MIN(TileX1, X1);
+			int FillY1 = MIN(TileY1, Y1);
+			if (Changes) FramebufferFillColor(GlobalFramebuffer, FillX0, FillY0, FillX1, FillY1, ClearColor);
+			if (Depth) FramebufferFillDepth(GlobalFramebuffer, FillX0, FillY0, FillX1, FillY1, ClearDepth);
+		}
+	}
+	if (Color) GlobalFramebuffer->ClearedColor = ClearColor;
+}
+
+void glClearDepth(GLfloat depth)
+{
+	ClearDepthValue = MIN(MAX(depth, 0.0f), 1.0f);
+}
+
+void glDepthFunc(GLenum func)
+{
+	DepthFunc = func;
+}
+
+void glDepthMask(GLboolean flag)
+{
+	DepthWriteEnabled = flag;
+}
+
+void glEnable(GLenum cap)
+{
+	if (cap == GL_DEPTH_TEST) DepthTestEnabled = GL_TRUE;
+}
+
+void glDisable(GLenum cap)
+{
+	if (cap == GL_DEPTH_TEST) DepthTestEnabled = GL_FALSE;
+}
+
+// Rows count from the top like the viewport's, and are returned top row first
+void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* data)
+{
+	if (format != GL_RGBA || type != GL_UNSIGNED_BYTE) return;
+
+	FramebufferSync(GlobalFramebuffer);
+	if (!GlobalFramebuffer->ColorAttachment) return;
+	if (x < 0 || y < 0 || x + width > GlobalFramebuffer->Width || y + height > GlobalFramebuffer->Height) return;
+
+	uint8_t* Out = (uint8_t*)data;
+	for (int j = 0; j < height; j++)
+	{
+		for (int i = 0; i < width; i++)
+		{
+			float R, G, B, A;
+			FramebufferTouch(x + i, y + j);
+			FramebufferRead(x + i, y + j, &R, &G, &B, &A);
+			Out[0] = (uint8_t)(R * 255.0f + 0.5f);
+			Out[1] = (uint8_t)(G * 255.0f + 0.5f);
+			Out[2] = (uint8_t)(B * 255.0f + 0.5f);
+			Out[3] = (uint8_t)(A * 255.0f + 0.5f);
+			Out += 4;
 		}
 	}
 }
 
 void glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
 {
+	if (GlobalFramebuffer == DefaultFramebuffer && ViewportScale != 1.0f)
+	{
+		// Both edges are rounded, so viewports sharing an edge still share it once scaled
+		int X1 = (int)((x + width) * ViewportScale + 0.5f);
+		int Y1 = (int)((y + height) * ViewportScale + 0.5f);
+		x = (int)(x * ViewportScale + 0.5f);
+		y = (int)(y * ViewportScale + 0.5f);
+		width = X1 - x;
+		height = Y1 - y;
+	}
+
 	ViewportX = x;
 	ViewportY = y;
 	ViewportWidth = width;
 	ViewportHeight = height;
 }
 
+void glViewportScale(GLfloat scale)
+{
+	ViewportScale = scale > 0.0f ? scale : 1.0f;
+}
+
 glslVec4 Sub(glslVec4 x, glslVec4 y)
 {
 	x.x -= y.x;
@@ -5190,22 +6662,6 @@ glslExValue InterpolateLinearEx(glslExValue a, glslExValue b, glslExValue c, flo
 	return Out;
 }
 
-float DistBetweenPointAndLine(float x1, float y1, float x2, float y2, float x3, float y3) {
-
-	float m, c;
-
-	m = (y2 - y1) / (x2 - x1);
-	c = y1 - m * x1;
-
-	float distance;
-	distance = (m * x3 - y3 + c);
-	if (distance < 0.0f) distance *= -1.0f;
-	distance *= swgl_rsqrt(m * m + 1);
-
-	return distance;
-}
-
-
 void PlaceFragShader()
 {
 	memcpy(GlobalCodeAddr, ActiveProgram->FragmentShaderBin.Data, ActiveProgram->FragmentShaderBin.Size);
@@ -5245,250 +6701,612 @@ void AssignAddrToVar(glslVariable* Var)
 	if (Var->Type == GLSL_MAT3) CopyBytes = 4 * 3 * 3;
 	if (Var->Type == GLSL_MAT4) CopyBytes = 4 * 4 * 4;
 
-	memcpy(Var->Value.Data, (void*)Var->Addr, CopyBytes);
+	memcpy(Var->Value.Data, (void*)Var->Addr, CopyBytes);
+}
+
+void PushRegisters() 
+{
+}
+
+void PopRegisters() 
+{
+
+}
+
+void FragVarsToShader()
+{
+	for (int i = 0; i < ActiveProgram->FragmentShader.GlobalVars.Size;i++)
+	{
+		glslVariable* Var;
+		VectorRead(&ActiveProgram->FragmentShader.GlobalVars, &Var, i);
+		
+		AssignVarToAddr(Var);
+	}
+}
+
+void FragVarsFromShader()
+{
+	for (int i = 0; i < ActiveProgram->FragmentShader.GlobalVars.Size; i++)
+	{
+		glslVariable* Var;
+		VectorRead(&ActiveProgram->FragmentShader.GlobalVars, &Var, i);
+
+		AssignAddrToVar(Var);
+	}
+}
+
+void VertVarsToShader()
+{
+	for (int i = 0; i < ActiveProgram->VertexShader.GlobalVars.Size; i++)
+	{
+		glslVariable* Var;
+		VectorRead(&ActiveProgram->VertexShader.GlobalVars, &Var, i);
+
+		if (Var->isLayout) continue; // Written straight into the shader by VertexArrayFetch
+
+		AssignVarToAddr(Var);
+	}
+}
+
+void VertVarsFromShader()
+{
+	for (int i = 0; i < ActiveProgram->VertexShader.GlobalVars.Size; i++)
+	{
+		glslVariable* Var;
+		VectorRead(&ActiveProgram->VertexShader.GlobalVars, &Var, i);
+		
+		AssignAddrToVar(Var);
+	}
+}
+
+typedef volatile void (*_ShaderProc)();
+
+
+// Barycentric weights of (x, y) corrected for perspective, returns 0 when the point is outside the triangle
+uint8_t PerspectiveBarycentric(glslVec4* Coords, float x, float y, float* u, float* v, float* w)
+{
+	glslVec4 MyPoint = { x, y, 0.0f, 0.0f };
+
+	Barycentric(Coords[0], Coords[1], Coords[2], MyPoint, u, v, w);
+
+	uint8_t Inside = *u >= 0.0f && *v >= 0.0f && *w >= 0.0f;
+
+	float uCorrected = *u / Coords[0].w;
+	float vCorrected = *v / Coords[1].w;
+	float wCorrected = *w / Coords[2].w;
+
+	float sum = uCorrected + vCorrected + wCorrected;
+
+	*u = uCorrected / sum;
+	*v = vCorrected / sum;
+	*w = wCorrected / sum;
+
+	return Inside;
+}
+
+/*
+* Picks the mip level of every texture unit for the 2x2 quad starting at (x, y).
+* The UV derivatives come from the first vec2 varying, which is what gets passed to texture() in practice,
+* and are scaled by each bound texture's real size. The chosen level is written into the texture table the shader code reads.
+*/
+void SelectQuadLod(glslVec4* Coords, _Vector* CoordData, float x, float y)
+{
+	int UVIdx = -1;
+	for (int i = 0; i < CoordData[0].Size; i++)
+	{
+		_ExVarPair Varying;
+		VectorRead(&CoordData[0], &Varying, i);
+		if (Varying.first.Type == GLSL_VEC2)
+		{
+			UVIdx = i;
+			break;
+		}
+	}
+
+	float dUdx = 0.0f, dVdx = 0.0f, dUdy = 0.0f, dVdy = 0.0f;
+
+	if (UVIdx != -1)
+	{
+		_ExVarPair A, B, C;
+		VectorRead(&CoordData[0], &A, UVIdx);
+		VectorRead(&CoordData[1], &B, UVIdx);
+		VectorRead(&CoordData[2], &C, UVIdx);
+
+		float u, v, w;
+		PerspectiveBarycentric(Coords, x, y, &u, &v, &w);
+		glslExValue UV = InterpolateLinearEx(A.first, B.first, C.first, u, v, w);
+
+		PerspectiveBarycentric(Coords, x + 1.0f, y, &u, &v, &w);
+		glslExValue UVx = InterpolateLinearEx(A.first, B.first, C.first, u, v, w);
+
+		PerspectiveBarycentric(Coords, x, y + 1.0f, &u, &v, &w);
+		glslExValue UVy = InterpolateLinearEx(A.first, B.first, C.first, u, v, w);
+
+		dUdx = UVx.x - UV.x;
+		dVdx = UVx.y - UV.y;
+		dUdy = UVy.x - UV.x;
+		dVdy = UVy.y - UV.y;
+	}
+
+	for (int Unit = 0; Unit < 8; Unit++)
+	{
+		Texture2D* Texture = TextureUnits[Unit];
+		if (!Texture || !Texture->Data) continue;
+
+		float Width = Texture->Width;
+		float Height = Texture->Height;
+
+		// Squared footprint of one pixel in texels along x and y
+		float RhoX = dUdx * dUdx * Width * Width + dVdx * dVdx * Height * Height;
+		float RhoY = dUdy * dUdy * Width * Width + dVdy * dVdy * Height * Height;
+		float Rho2 = MAX(RhoX, RhoY);
+
+		// floor(log2(sqrt(Rho2))) straight from the exponent bits
+		int Level = 0;
+		if (Rho2 >= 4.0f)
+		{
+			uint32_t Bits = *(uint32_t*)&Rho2;
+			Level = ((int)((Bits >> 23) & 0xFF) - 127) >> 1;
+		}
+		Level = MIN(Level, Texture->MipMaps.Size);
+
+		if (Level != TextureUnitLod[Unit])
+		{
+			TextureUnitLod[Unit] = Level;
+			((uint32_t*)GlobalTextureTableAddr)[Unit] = (uint32_t)TextureUnitLevelData(Unit, Level);
+		}
+	}
+}
+
+void ResetTextureLod()
+{
+	for (int Unit = 0; Unit < 8; Unit++)
+	{
+		if (TextureUnitLod[Unit] == 0) continue;
+		TextureUnitLod[Unit] = 0;
+		if (TextureUnits[Unit]) ((uint32_t*)GlobalTextureTableAddr)[Unit] = (uint32_t)TextureUnits[Unit]->Data;
+	}
+}
+
+void ShadeFragment(glslVec4* Coords, _Vector* CoordData, glslVariable* OutVar, float x, float y, float u, float v, float w)
+{
+	int Row = MIN(GlobalFramebuffer->Height - 1, MAX(0, ((ViewportHeight - ((int)y - ViewportY + 1)) + ViewportY)));
+
+	FramebufferTouch((int)x, Row);
+
+	if (DepthTestEnabled && GlobalFramebuffer->DepthAttachment)
+	{
+		// The weights are perspective correct, so clip z over clip w gives the NDC depth
+		float z = Coords[0].z * u + Coords[1].z * v + Coords[2].z * w;
+		float ClipW = Coords[0].w * u + Coords[1].w * v + Coords[2].w * w;
+		if (!FramebufferDepthTest((int)x, Row, z / ClipW * 0.5f + 0.5f)) return;
+	}
+
+	if (!GlobalFramebuffer->ColorAttachment) return;
+
+	for (int i = 0; i < CoordData[0].Size; i++)
+	{
+		_ExVarPair FirstArg, SecondArg, ThirdArg;
+
+		VectorRead(&CoordData[0], &FirstArg, i);
+		VectorRead(&CoordData[1], &SecondArg, i);
+		VectorRead(&CoordData[2], &ThirdArg, i);
+
+		glslExValue InterpVal = InterpolateLinearEx(FirstArg.first, SecondArg.first, ThirdArg.first, u, v, w);
+		AssignToExVal(FirstArg.second, InterpVal);
+	}
+
+	
+	FragVarsToShader();
+
+	((_ShaderProc)ActiveProgram->FragmentShaderBin.Data)();
+	//if (w < 0.5f && w > 0.4f) asm volatile ("cli\nhlt" :: "a"(ActiveProgram->FragmentShaderBin.Data));
+	
+	FragVarsFromShader();
+	
+	
+	float OutR, OutG, OutB, OutA;
+
+	OutR = ((float*)OutVar->Value.Data)[0];
+	OutG = ((float*)OutVar->Value.Data)[1];
+	OutB = ((float*)OutVar->Value.Data)[2];
+	OutA = ((float*)OutVar->Value.Data)[3];
+	
+	//OutA *= MIN((MIN(MIN(MIN(u, 1.0f - u), MIN(v, 1.0f - v)), MIN(w, 1.0f - w))) * 250.0f, 1.0f); // UNCOMMENT FOR AA
+
+	float CurR, CurG, CurB, CurA;
+	FramebufferRead((int)x, Row, &CurR, &CurG, &CurB, &CurA);
+
+	//OutR = CurR + OutA * (OutR - CurR);
+	//OutG = CurG + OutA * (OutG - CurG);
+	//OutB = CurB + OutA * (OutB - CurB);
+	//OutA = CurA + OutA * (OutA - CurA);
+
+	FramebufferWrite((int)x, Row, OutR, OutG, OutB, OutA);
+}
+
+// The color output of the fragment shader
+glslVariable* FragmentOutVar()
+{
+	for (int i = 0; i < ActiveProgram->FragmentShader.GlobalVars.Size; i++)
+	{
+		glslVariable* Var;
+
+		VectorRead(&ActiveProgram->FragmentShader.GlobalVars, &Var, i);
+
+		if (Var->isOut)
+		{
+			VerifyVar(Var);
+			return Var;
+		}
+	}
+
+	return 0;
+}
+
+void DrawTriangle(glslVec4* Coords, _Vector* CoordData)
+{
+	float minX = MAX(MIN(MIN(Coords[0].x, Coords[1].x), Coords[2].x), (float)ViewportX);
+	float maxX = MIN(MAX(MAX(Coords[0].x, Coords[1].x), Coords[2].x), (float)ViewportX + ViewportWidth);
+
+	float minY = MAX(MIN(MIN(Coords[0].y, Coords[1].y), Coords[2].y), (float)ViewportY);
+	float maxY = MIN(MAX(MAX(Coords[0].y, Coords[1].y), Coords[2].y), (float)ViewportY + ViewportHeight);
+
+	minX = MAX(minX, 0.0f);
+	maxX = MIN(maxX, GlobalFramebuffer->Width);
+
+	FramebufferDamageWindow(minX, minY, maxX, maxY);
+
+	glslVariable* OutVar = FragmentOutVar();
+
+	// Walk the bounding box in 2x2 quads so texture LOD can be chosen once per quad
+	for (float qy = minY; qy < maxY; qy += 2)
+	{
+		for (float qx = minX; qx < maxX; qx += 2)
+		{
+			uint8_t LodSelected = 0;
+
+			for (int Sub = 0; Sub < 4; Sub++)
+			{
+				float x = qx + (Sub & 1);
+				float y = qy + (Sub >> 1);
+				if (x >= maxX || y >= maxY) continue;
+
+				float u, v, w;
+				if (!PerspectiveBarycentric(Coords, x, y, &u, &v, &w)) continue;
+
+				if (!LodSelected)
+				{
+					SelectQuadLod(Coords, CoordData, qx, qy);
+					LodSelected = 1;
+				}
+
+				ShadeFragment(Coords, CoordData, OutVar, x, y, u, v, w);
+			}
+		}
+	}
+
+	ResetTextureLod();
 }
 
-void PushRegisters() 
+// Bytes per component of an attribute type, 0 for types the vertex fetch can't read
+int VertexAttribTypeSize(GLenum type)
 {
+	if (type == GL_FLOAT) return 4;
+	if (type == GL_UNSIGNED_BYTE) return 1;
+	if (type == GL_SHORT || type == GL_UNSIGNED_SHORT || type == GL_HALF_FLOAT) return 2;
+	if (type == GL_INT_2_10_10_10_REV) return 1; // 4 components packed in one 32-bit word
+	return 0;
 }
 
-void PopRegisters() 
+// Half floats to floats without F16C. Shifting the exponent and mantissa into place and scaling by 2^112
+// rebiases the exponent and handles denormals too, only infinity and NaN need their exponent set by hand.
+__m128 VertexHalfToFloat(__m128i Half)
 {
+	__m128i Sign = _mm_slli_epi32(_mm_and_si128(Half, _mm_set1_epi32(0x8000)), 16);
+	__m128i Bits = _mm_and_si128(Half, _mm_set1_epi32(0x7FFF));
+	__m128 Value = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(Bits, 13)), _mm_castsi128_ps(_mm_set1_epi32(0x77800000)));
 
+	__m128i InfNaN = _mm_and_si128(_mm_cmpgt_epi32(Bits, _mm_set1_epi32(0x7BFF)), _mm_set1_epi32(0x7F800000));
+	return _mm_or_ps(_mm_or_ps(Value, _mm_castsi128_ps(InfNaN)), _mm_castsi128_ps(Sign));
 }
 
-void FragVarsToShader()
+// Converts element i of an attribute to floats and writes its components into the shader input
+void VertexFetchLoad(VertexFetch* Fetch, int i)
 {
-	for (int i = 0; i < ActiveProgram->FragmentShader.GlobalVars.Size;i++)
+	uint8_t* Src = (uint8_t*)Fetch->buffer->data + i * Fetch->stride + Fetch->offset;
+
+	if (Fetch->type == GL_FLOAT)
 	{
-		glslVariable* Var;
-		VectorRead(&ActiveProgram->FragmentShader.GlobalVars, &Var, i);
-		
-		AssignVarToAddr(Var);
+		for (int k = 0; k < Fetch->size; k++) Fetch->Dest[k] = ((float*)Src)[k];
+		return;
 	}
-}
 
-void FragVarsFromShader()
-{
-	for (int i = 0; i < ActiveProgram->FragmentShader.GlobalVars.Size; i++)
+	// Only the components that exist are read, so the last element never loads past the end of the buffer
+	__m128 Value;
+	if (Fetch->type == GL_UNSIGNED_BYTE)
 	{
-		glslVariable* Var;
-		VectorRead(&ActiveProgram->FragmentShader.GlobalVars, &Var, i);
+		uint32_t Packed = 0;
+		for (int k = 0; k < Fetch->size; k++) Packed |= (uint32_t)Src[k] << (k * 8);
 
-		AssignAddrToVar(Var);
+		Value = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(Packed)));
+		if (Fetch->normalized) Value = _mm_mul_ps(Value, _mm_set1_ps(1.0f / 255.0f));
 	}
-}
+	else if (Fetch->type == GL_INT_2_10_10_10_REV)
+	{
+		uint32_t Packed = *(uint32_t*)Src;
 
-void VertVarsToShader()
-{
-	for (int i = 0; i < ActiveProgram->VertexShader.GlobalVars.Size; i++)
+		// Each field is moved to the top of its lane and shifted back down to sign extend it
+		__m128i Fields = _mm_set_epi32(Packed, Packed << 2, Packed << 12, Packed << 22);
+		__m128i Ints = _mm_blend_epi16(_mm_srai_epi32(Fields, 22), _mm_srai_epi32(Fields, 30), 0xC0);
+
+		Value = _mm_cvtepi32_ps(Ints);
+		if (Fetch->normalized) Value = _mm_max_ps(_mm_mul_ps(Value, _mm_setr_ps(1.0f / 511.0f, 1.0f / 511.0f, 1.0f / 511.0f, 1.0f)), _mm_set1_ps(-1.0f));
+	}
+	else
 	{
-		glslVariable* Var;
-		VectorRead(&ActiveProgram->VertexShader.GlobalVars, &Var, i);
+		uint16_t Halves[4] = { 0, 0, 0, 0 };
+		for (int k = 0; k < Fetch->size; k++) Halves[k] = ((uint16_t*)Src)[k];
+		__m128i Packed = _mm_loadl_epi64((__m128i*)Halves);
 
-		AssignVarToAddr(Var);
+		if (Fetch->type == GL_SHORT)
+		{
+			Value = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(Packed));
+			if (Fetch->normalized) Value = _mm_max_ps(_mm_mul_ps(Value, _mm_set1_ps(1.0f / 32767.0f)), _mm_set1_ps(-1.0f));
+		}
+		else if (Fetch->type == GL_UNSIGNED_SHORT)
+		{
+			Value = _mm_cvtepi32_ps(_mm_cvtepu16_epi32(Packed));
+			if (Fetch->normalized) Value = _mm_mul_ps(Value, _mm_set1_ps(1.0f / 65535.0f));
+		}
+		else
+		{
+			Value = VertexHalfToFloat(_mm_cvtepu16_epi32(Packed));
+		}
 	}
-}
 
-void VertVarsFromShader()
-{
-	for (int i = 0; i < ActiveProgram->VertexShader.GlobalVars.Size; i++)
+	if (Fetch->size == 4)
 	{
-		glslVariable* Var;
-		VectorRead(&ActiveProgram->VertexShader.GlobalVars, &Var, i);
-		
-		AssignAddrToVar(Var);
+		_mm_storeu_ps(Fetch->Dest, Value);
+	}
+	else
+	{
+		float Components[4];
+		_mm_storeu_ps(Components, Value);
+		for (int k = 0; k < Fetch->size; k++) Fetch->Dest[k] = Components[k];
 	}
 }
 
-typedef volatile void (*_ShaderProc)();
-
-
-void DrawTriangle(glslVec4* Coords, _Vector* CoordData)
+// Resolves which layout variable of ActiveProgram every attribute of VertArray feeds, only redone when either side changed
+void VertexArrayBuildFetches(VertexArray* VertArray)
 {
-	float minX = MAX(MIN(MIN(Coords[0].x, Coords[1].x), Coords[2].x), (float)ViewportX);
-	float maxX = MIN(MAX(MAX(Coords[0].x, Coords[1].x), Coords[2].x), (float)ViewportX + ViewportWidth);
+	if (VertArray->FetchProgram == ActiveProgram && VertArray->FetchLinkCount == ActiveProgram->LinkCount) return;
 
-	float minY = MAX(MIN(MIN(Coords[0].y, Coords[1].y), Coords[2].y), (float)ViewportY);
-	float maxY = MIN(MAX(MAX(Coords[0].y, Coords[1].y), Coords[2].y), (float)ViewportY + ViewportHeight);
-
-	
-	MipMapLevel = 80.0f / DistBetweenPointAndLine(Coords[0].x, Coords[0].y, Coords[1].x, Coords[1].y, Coords[2].x, Coords[2].y);
+	VertArray->Fetches.Size = 0;
+	VertArray->InstanceFetches.Size = 0;
 
-	glslVariable* OutVar;
-	for (int _i = 0; _i < ActiveProgram->FragmentShader.GlobalVars.Size; _i++)
+	for (int i = 0; i < VertArray->Attribs.Size; i++)
 	{
-		glslVariable* Var;
+		VertexArrayAttrib Attrib;
+		VectorRead(&VertArray->Attribs, &Attrib, i);
 
-		VectorRead(&ActiveProgram->FragmentShader.GlobalVars, &Var, _i);
+		if (!Attrib.buffer) continue;
+		if (!VertexAttribTypeSize(Attrib.type)) continue;
+		if (Attrib.type == GL_INT_2_10_10_10_REV && Attrib.size != 4) continue; // By specification, packed attributes always have 4 components
 
+		// A stride of 0 means the elements are tightly packed
+		GLsizei Stride = Attrib.stride;
+		if (Stride == 0) Stride = Attrib.type == GL_INT_2_10_10_10_REV ? 4 : Attrib.size * VertexAttribTypeSize(Attrib.type);
 
-		if (Var->isOut)
+		for (int j = 0; j < ActiveProgram->VertexShader.GlobalVars.Size; j++)
 		{
+			glslVariable* Var;
+			VectorRead(&ActiveProgram->VertexShader.GlobalVars, &Var, j);
+
+			if (!Var->isLayout || Var->Layout->Location != Attrib.index) continue;
+
+			CompVerifyVar(Var);
 			VerifyVar(Var);
-			OutVar = Var;
-			break;
+
+			VertexFetch Fetch = { Attrib.buffer, Attrib.offset, Stride, Attrib.size, Attrib.type, Attrib.normalized, Attrib.divisor, (float*)Var->Addr };
+			VectorPushBack(Attrib.divisor ? &VertArray->InstanceFetches : &VertArray->Fetches, &Fetch);
 		}
 	}
 
-	for (float y = minY; y < maxY; y++)
+	VertArray->FetchProgram = ActiveProgram;
+	VertArray->FetchLinkCount = ActiveProgram->LinkCount;
+}
+
+// Loads the per vertex attributes of vertex i into the vertex shader's inputs
+void VertexArrayFetch(VertexArray* VertArray, int i)
+{
+	VertexFetch* Fetch = (VertexFetch*)VertArray->Fetches.Data;
+
+	for (int j = 0; j < VertArray->Fetches.Size; j++, Fetch++)
 	{
-		for (float x = MAX(minX, 0.0f); x < MIN(maxX, GlobalFramebuffer->Width); x++)
-		{
-			glslVec4 MyPoint = { x, y, 0.0f, 0.0f };
+		if (Fetch->buffer->data) VertexFetchLoad(Fetch, i);
+	}
+}
 
-			float u, v, w;
-			Barycentric(Coords[0], Coords[1], Coords[2], MyPoint, &u, &v, &w);
+// Loads the per instance attributes, nothing else writes those inputs so they hold for every vertex of the instance
+void VertexArrayFetchInstance(VertexArray* VertArray, int Instance)
+{
+	VertexFetch* Fetch = (VertexFetch*)VertArray->InstanceFetches.Data;
 
-			if (u >= 0.0f && v >= 0.0f && w >= 0.0f)
-			{
-	
-				float uCorrected = u / Coords[0].w;
-				float vCorrected = v / Coords[1].w;
-				float wCorrected = w / Coords[2].w;
+	for (int j = 0; j < VertArray->InstanceFetches.Size; j++, Fetch++)
+	{
+		if (Fetch->buffer->data) VertexFetchLoad(Fetch, Instance / Fetch->divisor);
+	}
+}
 
-				float sum = uCorrected + vCorrected + wCorrected;
+// A vertex after the vertex shader ran, kept while strips and fans can still use it
+typedef struct
+{
+	glslVec4 Position;
+	_Vector Varyings; // Of type _ExVarPair, from DrawArena and refilled by every ShadeVertex
+} ShadedVertex;
 
+// Done once per draw, all vertices of a program have the same varyings so the storage never grows
+void InitShadedVertex(ShadedVertex* Vertex)
+{
+	Vertex->Varyings = NewArenaVector(DrawArena, sizeof(_ExVarPair), ActiveProgram->VertexFragInOut.Size + 1);
+}
 
-				uCorrected /= sum;
-				vCorrected /= sum;
-				wCorrected /= sum;
+void ShadeVertex(int i, glslVariable* glPositionVar, ShadedVertex* Out)
+{
+	VertexArrayFetch(ActiveVertexArray, i);
 
-				u = uCorrected;
-				v = vCorrected;
-				w = wCorrected;
+	VertVarsToShader();
 
-				float z = (Coords[0].z * u + Coords[1].z * v + Coords[2].z * w);
+	((_ShaderProc)ActiveProgram->VertexShaderBin.Data)();
 
-				if (GlobalFramebuffer->DepthFormat == GL_FLOAT)
-				{
-					float* CurZ = &(((float*)GlobalFramebuffer->DepthAttachment)[(int)x + MIN(GlobalFramebuffer->Height - 1, MAX(0, ((ViewportHeight - ((int)y - ViewportY + 1)) + ViewportY))) * GlobalFramebuffer->Width]);
-					if (*CurZ == 0.0f || *CurZ >= z)
-					{
-						*CurZ = z;
+	VertVarsFromShader();
 
-						uint32_t* CurCol = &(GlobalFramebuffer->ColorAttachment[(int)x + MIN(GlobalFramebuffer->Height - 1, MAX(0, ((ViewportHeight - ((int)y - ViewportY + 1)) + ViewportY))) * GlobalFramebuffer->Width]);
+	Out->Position.x = ((float*)glPositionVar->Value.Data)[0];
+	Out->Position.y = ((float*)glPositionVar->Value.Data)[1];
+	Out->Position.z = ((float*)glPositionVar->Value.Data)[2];
+	Out->Position.w = ((float*)glPositionVar->Value.Data)[3];
 
+	Out->Varyings.Size = 0;
 
-						for (int i = 0; i < CoordData[0].Size; i++)
-						{
-							_ExVarPair FirstArg, SecondArg, ThirdArg;
+	for (int k = 0; k < ActiveProgram->VertexFragInOut.Size; k++)
+	{
+		_VarPair InOut;
 
-							VectorRead(&CoordData[0], &FirstArg, i);
-							VectorRead(&CoordData[1], &SecondArg, i);
-							VectorRead(&CoordData[2], &ThirdArg, i);
+		VectorRead(&ActiveProgram->VertexFragInOut, &InOut, k);
 
-							glslExValue InterpVal = InterpolateLinearEx(FirstArg.first, SecondArg.first, ThirdArg.first, u, v, w);
-							AssignToExVal(FirstArg.second, InterpVal);
-						}
+		if (InOut.first->Type != InOut.second->Type)
+		{
+			continue;
+		}
 
-						
-						FragVarsToShader();
-
-						((_ShaderProc)ActiveProgram->FragmentShaderBin.Data)();
-						//if (w < 0.5f && w > 0.4f) asm volatile ("cli\nhlt" :: "a"(ActiveProgram->FragmentShaderBin.Data));
-						
-						FragVarsFromShader();
-						
-						
-						float OutR, OutG, OutB, OutA;
-
-						OutR = ((float*)OutVar->Value.Data)[0] * 255;
-						OutG = ((float*)OutVar->Value.Data)[1] * 255;
-						OutB = ((float*)OutVar->Value.Data)[2] * 255;
-						OutA = ((float*)OutVar->Value.Data)[3];
-						
-						//OutA *= MIN((MIN(MIN(MIN(u, 1.0f - u), MIN(v, 1.0f - v)), MIN(w, 1.0f - w))) * 250.0f, 1.0f); // UNCOMMENT FOR AA
-
-						float CurR = ((*CurCol >> 24) & 0xFF);
-						float CurG = ((*CurCol >> 16) & 0xFF);
-						float CurB = ((*CurCol >> 8) & 0xFF);
-						float CurA = (*CurCol & 0xFF);
-
-						//OutR = CurR + OutA * (OutR - CurR);
-						//OutG = CurG + OutA * (OutG - CurG);
-						//OutB = CurB + OutA * (OutB - CurB);
-						//OutA = CurA + OutA * (OutA - CurA);
-
-						uint32_t Color;
-
-						if (GlobalFramebuffer->ColorFormat == GL_RGB)
-						{
-							Color = 0xFF;
-							Color |= (uint32_t)(OutR) << 24;
-							Color |= (uint32_t)(OutG) << 16;
-							Color |= (uint32_t)(OutB) << 8;
-						}
-						else if (GlobalFramebuffer->ColorFormat == GL_RGBA)
-						{
-							Color = 0x0;
-							Color |= (uint32_t)(OutR) << 24;
-							Color |= (uint32_t)(OutG) << 16;
-							Color |= (uint32_t)(OutB) << 8;
-							Color |= (uint32_t)(OutA);
-						}
+		glslExValue OutExValue = VarToExVal(InOut.second);
 
-						*CurCol = Color;
-					}
-				}
-			}
+		_ExVarPair OutPair = { OutExValue, InOut.first };
+
+		VectorPushBack(&Out->Varyings, &OutPair);
+	}
+}
+
+// Clip space to the window coordinates DrawTriangle and DrawLine work in
+glslVec4 ClipToWindow(glslVec4 Position)
+{
+	glslVec4 Out;
+	Out.x = (int)(Position.x / Position.w * (ViewportWidth / 2) + (ViewportWidth / 2) + ViewportX);
+	Out.y = (int)(Position.y / Position.w * (ViewportHeight / 2) + (ViewportHeight / 2) + ViewportY);
+	Out.z = Position.z;
+	Out.w = Position.w;
+	return Out;
+}
+
+// Clips the triangle against the near plane and rasterizes what is left, the shaded vertices are only read
+void AssembleTriangle(ShadedVertex* V0, ShadedVertex* V1, ShadedVertex* V2)
+{
+	Triangle MyTri;
+	MyTri.Verts[0] = V0->Position;
+	MyTri.Verts[1] = V1->Position;
+	MyTri.Verts[2] = V2->Position;
+	MyTri.TriangleVertexData[0] = V0->Varyings;
+	MyTri.TriangleVertexData[1] = V1->Varyings;
+	MyTri.TriangleVertexData[2] = V2->Varyings;
+
+	ArenaMark Mark = ArenaGetMark(DrawArena);
+
+	Triangle Triangles[2];
+	int nTri = ClipTriangleAgainstNearPlane(&MyTri, Triangles);
+	for (int k = 0; k < nTri; k++)
+	{
+		Triangle Tri = Triangles[k];
+		glslVec4 TriangleCoords[3];
+		for (int j = 0; j < 3; j++)
+		{
+			TriangleCoords[j] = ClipToWindow(Tri.Verts[j]);
 		}
+		DrawTriangle(TriangleCoords, Tri.TriangleVertexData);
 	}
+
+	ArenaRelease(DrawArena, Mark);
 }
 
-void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+// Clips the line against the near plane and steps one pixel at a time along its longer axis.
+// The last pixel is left out like in GL, so lines sharing an end point don't draw it twice.
+void DrawLine(ShadedVertex* V0, ShadedVertex* V1)
 {
-	if (!ActiveVertexArray) return;
-	if (!ActiveProgram) return;
+	glslVec4 Ends[2] = { V0->Position, V1->Position };
+	_Vector EndData[2] = { V0->Varyings, V1->Varyings };
 
-	glslVariable* glPositionVar = 0;
+	uint8_t Inside0 = Ends[0].z >= -Ends[0].w;
+	uint8_t Inside1 = Ends[1].z >= -Ends[1].w;
+	if (!Inside0 && !Inside1) return;
 
-	for (int i = 0; i < ActiveProgram->VertexShader.GlobalVars.Size; i++)
+	ArenaMark Mark = ArenaGetMark(DrawArena);
+
+	if (!Inside0 || !Inside1)
 	{
-		glslVariable* Var;
+		int In = Inside0 ? 0 : 1;
+		int Out = 1 - In;
 
-		VectorRead(&ActiveProgram->VertexShader.GlobalVars, &Var, i);
+		float t;
+		Ends[Out] = IntersectNearPlane(Ends[In], Ends[Out], &t);
 
-		if (StringEquals(Var->Name, "gl_Position"))
+		_Vector ClippedData = NewArenaVector(DrawArena, sizeof(_ExVarPair), EndData[In].Size + 1);
+		for (int i = 0; i < EndData[In].Size; i++)
 		{
-			glPositionVar = Var;
+			_ExVarPair Pair0, Pair1;
+			VectorRead(&EndData[In], &Pair0, i);
+			VectorRead(&EndData[Out], &Pair1, i);
+			Pair0.first = InterpolateExValue(Pair0.first, Pair1.first, t);
+			VectorPushBack(&ClippedData, &Pair0);
 		}
+		EndData[Out] = ClippedData;
 	}
 
-	VerifyVar(glPositionVar);
+	// ShadeFragment interpolates over a triangle, a line is one whose last two corners are the same
+	glslVec4 Coords[3];
+	Coords[0] = ClipToWindow(Ends[0]);
+	Coords[1] = ClipToWindow(Ends[1]);
+	Coords[2] = Coords[1];
+	_Vector CoordData[3] = { EndData[0], EndData[1], EndData[1] };
 
-	if (mode == GL_POINTS)
-	{
-		for (int i = first; i < first + count; i++)
-		{
-			for (int j = 0; j < ActiveVertexArray->Attribs.Size; j++)
-			{
-				VertexArrayAttrib Attrib;
+	glslVariable* OutVar = FragmentOutVar();
 
-				VectorRead(&ActiveVertexArray->Attribs, &Attrib, j);
+	float minX = MAX((float)ViewportX, 0.0f);
+	float maxX = MIN((float)ViewportX + ViewportWidth, GlobalFramebuffer->Width);
+	float minY = ViewportY;
+	float maxY = ViewportY + ViewportHeight;
 
-				if (Attrib.type == GL_FLOAT)
-				{
-					float* AttribData = (float*)((uint8_t*)ActiveVertexArray->VertexBuffer->data + i * Attrib.stride + Attrib.offset);
+	FramebufferDamageWindow(MAX(MIN(Coords[0].x, Coords[1].x), minX), MAX(MIN(Coords[0].y, Coords[1].y), minY), MIN(MAX(Coords[0].x, Coords[1].x), maxX), MIN(MAX(Coords[0].y, Coords[1].y), maxY));
 
-					for (int k = 0; k < ActiveProgram->Layouts.Size; k++)
-					{
-						glslVariable* Var;
+	float dx = Coords[1].x - Coords[0].x;
+	float dy = Coords[1].y - Coords[0].y;
+	int Steps = MAX(MAX(dx, -dx), MAX(dy, -dy));
+
+	for (int s = 0; s < Steps; s++)
+	{
+		float t = s / (float)Steps;
+		float x = Coords[0].x + dx * t;
+		float y = Coords[0].y + dy * t;
+		if (x < minX || x >= maxX || y < minY || y >= maxY) continue;
 
-						VectorRead(&ActiveProgram->Layouts, &Var, k);
+		// Perspective correct weights of the two ends
+		float u = (1.0f - t) / Coords[0].w;
+		float v = t / Coords[1].w;
+		float Sum = u + v;
 
-						if (Var->Layout->Location == Attrib.index)
-						{
-							if (Var->Value.Alloc != 1)
-							{
-								Var->Value.Alloc = 1;
-								Var->Value.Data = malloc(Attrib.size * sizeof(float));
-							}
-							memcpy(Var->Value.Data, AttribData, Attrib.size * sizeof(float));
-						}
-					}
-				}
-			}
+		ShadeFragment(Coords, CoordData, OutVar, (int)x, (int)y, u / Sum, v / Sum, 0.0f);
+	}
+
+	ArenaRelease(DrawArena, Mark);
+}
+
+// Runs the pipeline over vertices [first, first + count) of the current instance
+void DrawArraysPrimitives(GLenum mode, GLint first, GLsizei count, glslVariable* glPositionVar)
+{
+	if (mode == GL_POINTS)
+	{
+		for (int i = first; i < first + count; i++)
+		{
+			VertexArrayFetch(ActiveVertexArray, i);
 
 			VertVarsToShader();
 
@@ -5503,6 +7321,9 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
 			if (OutPosX < 0 || OutPosX >= GlobalFramebuffer->Width) continue;
 			if (OutPosY < 0 || OutPosY >= GlobalFramebuffer->Height) continue;
 
+			FramebufferDamage(OutPosX, OutPosY, OutPosX + 1, OutPosY + 1);
+			FramebufferTouch(OutPosX, OutPosY);
+
 			for (int j = 0; j < ActiveProgram->VertexFragInOut.Size; j++)
 			{
 				_VarPair InOut;
@@ -5548,164 +7369,177 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
 			OutB = MIN(MAX(OutB, 0.0f), 1.0f);
 			OutA = MIN(MAX(OutA, 0.0f), 1.0f);
 
-			if (GlobalFramebuffer->DepthAttachment)
+			if (DepthTestEnabled && GlobalFramebuffer->DepthAttachment)
 			{
-				if (GlobalFramebuffer->DepthFormat == GL_FLOAT)
-				{
-					float OutPosZ = ((float*)glPositionVar->Value.Data)[2];
-					((float*)GlobalFramebuffer->DepthAttachment)[OutPosX + OutPosY * GlobalFramebuffer->Width] = OutPosZ;
-				}
+				float OutPosZ = ((float*)glPositionVar->Value.Data)[2] / ((float*)glPositionVar->Value.Data)[3];
+				if (!FramebufferDepthTest(OutPosX, OutPosY, OutPosZ * 0.5f + 0.5f)) continue;
 			}
 
 			if (GlobalFramebuffer->ColorAttachment)
 			{
-				if (GlobalFramebuffer->ColorFormat == GL_RGB)
-				{
-					uint32_t Color = 0xFF;
-					Color |= (int)(OutR * 255) << 24;
-					Color |= (int)(OutG * 255) << 16;
-					Color |= (int)(OutB * 255) << 8;
-					GlobalFramebuffer->ColorAttachment[OutPosX + OutPosY * GlobalFramebuffer->Width] = Color;
-				}
-				else if (GlobalFramebuffer->ColorFormat == GL_RGBA)
-				{
-					uint32_t Color = 0;
-					Color |= (int)(OutR * 255) << 24;
-					Color |= (int)(OutG * 255) << 16;
-					Color |= (int)(OutB * 255) << 8;
-					Color |= (int)(OutA * 255);
-					GlobalFramebuffer->ColorAttachment[OutPosX + OutPosY * GlobalFramebuffer->Width] = Color;
-				}
+				FramebufferWrite(OutPosX, OutPosY, OutR, OutG, OutB, OutA);
 			}
 		}
 	}
 	else if (mode == GL_TRIANGLES)
 	{
-		for (int i = first; i < first + count; i += 3)
-		{
-			glslVec4 TriangleCoords[3];
+		ShadedVertex Verts[3];
+		for (int j = 0; j < 3; j++) InitShadedVertex(&Verts[j]);
 
-			// ORIGINALLY DEFINED AS std::vector<std::pair<glslExValue, glslVariable*>> TriangleVertexData[3];
-			_Vector TriangleVertexData[3];
+		for (int i = first; i + 2 < first + count; i += 3)
+		{
+			for (int j = 0; j < 3; j++) ShadeVertex(i + j, glPositionVar, &Verts[j]);
 
-			for (int j = 0; j < 3; j++)
-			{
-				for (int k = 0; k < ActiveVertexArray->Attribs.Size; k++)
-				{
-					VertexArrayAttrib Attrib;
-					VectorRead(&ActiveVertexArray->Attribs, &Attrib, k);
-					if (Attrib.type == GL_FLOAT)
-					{
-						float* AttribData = (float*)((uint8_t*)ActiveVertexArray->VertexBuffer->data + (i + j) * Attrib.stride + Attrib.offset);
+			AssembleTriangle(&Verts[0], &Verts[1], &Verts[2]);
+		}
+	}
+	else if (mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN)
+	{
+		// Every vertex is shaded once, each triangle after the first reuses two that already were.
+		// Strips cycle through the three slots, fans keep the center in slot 0 and alternate the others.
+		ShadedVertex Verts[3];
+		for (int j = 0; j < 3; j++) InitShadedVertex(&Verts[j]);
 
-						for (int k = 0; k < ActiveProgram->Layouts.Size; k++)
-						{
-							glslVariable* Var;
-							VectorRead(&ActiveProgram->Layouts, &Var, k);
-							VerifyVar(Var);
-							if (Var->Layout->Location == Attrib.index)
-							{
-								memcpy(Var->Value.Data, AttribData, Attrib.size * sizeof(float));
-							}
-						}
-					}
-				}
+		for (int n = 0; n < count; n++)
+		{
+			int Slot = n % 3;
+			if (mode == GL_TRIANGLE_FAN) Slot = n == 0 ? 0 : 1 + (n - 1) % 2;
 
-				// asm volatile ("cli\nhlt\n" :: "a"(ActiveProgram->VertexShaderBin.Data));
-				VertVarsToShader();
+			ShadeVertex(first + n, glPositionVar, &Verts[Slot]);
 
-				((_ShaderProc)ActiveProgram->VertexShaderBin.Data)();
+			if (n < 2) continue;
 
-				VertVarsFromShader();
+			if (mode == GL_TRIANGLE_FAN)
+			{
+				AssembleTriangle(&Verts[0], &Verts[1 + n % 2], &Verts[Slot]);
+			}
+			else if (n % 2)
+			{
+				// Odd triangles swap their first two vertices to keep the strip's winding
+				AssembleTriangle(&Verts[(n - 1) % 3], &Verts[(n - 2) % 3], &Verts[Slot]);
+			}
+			else
+			{
+				AssembleTriangle(&Verts[(n - 2) % 3], &Verts[(n - 1) % 3], &Verts[Slot]);
+			}
+		}
+	}
+	else if (mode == GL_LINES)
+	{
+		ShadedVertex Verts[2];
+		InitShadedVertex(&Verts[0]);
+		InitShadedVertex(&Verts[1]);
 
-				TriangleCoords[j].x = ((float*)glPositionVar->Value.Data)[0];
-				TriangleCoords[j].y = ((float*)glPositionVar->Value.Data)[1];
-				TriangleCoords[j].z = ((float*)glPositionVar->Value.Data)[2];
-				TriangleCoords[j].w = ((float*)glPositionVar->Value.Data)[3];
+		for (int i = first; i + 1 < first + count; i += 2)
+		{
+			ShadeVertex(i, glPositionVar, &Verts[0]);
+			ShadeVertex(i + 1, glPositionVar, &Verts[1]);
 
+			DrawLine(&Verts[0], &Verts[1]);
+		}
+	}
+}
 
-				TriangleVertexData[j] = NewVector(sizeof(_ExVarPair));
+void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount)
+{
+	if (!ActiveVertexArray) return;
+	if (!ActiveProgram) return;
+	if (!ActiveProgram->PositionVar) return;
 
-				for (int k = 0; k < ActiveProgram->VertexFragInOut.Size; k++)
-				{
-					_VarPair InOut;
+	FramebufferSync(GlobalFramebuffer);
 
-					VectorRead(&ActiveProgram->VertexFragInOut, &InOut, k);
+	VertexArrayBuildFetches(ActiveVertexArray);
 
-					if (InOut.first->Type != InOut.second->Type)
-					{
-						continue;
-					}
+	VerifyVar(ActiveProgram->PositionVar);
 
-					glslExValue OutExValue = VarToExVal(InOut.second);
+	glslVariable* InstanceIDVar = ActiveProgram->InstanceIDVar;
+	if (InstanceIDVar) VerifyVar(InstanceIDVar);
 
-					_ExVarPair OutPair = { OutExValue, InOut.first };
+	for (int Instance = 0; Instance < instancecount; Instance++)
+	{
+		VertexArrayFetchInstance(ActiveVertexArray, Instance);
+		if (InstanceIDVar) ((int*)InstanceIDVar->Value.Data)[0] = Instance;
 
-					VectorPushBack(&TriangleVertexData[j], &OutPair);
-				}
-			}
+		DrawArraysPrimitives(mode, first, count, ActiveProgram->PositionVar);
 
-			Triangle MyTri;
-			MyTri.Verts[0] = TriangleCoords[0];
-			MyTri.Verts[1] = TriangleCoords[1];
-			MyTri.Verts[2] = TriangleCoords[2];
-			MyTri.TriangleVertexData[0] = TriangleVertexData[0];
-			MyTri.TriangleVertexData[1] = TriangleVertexData[1];
-			MyTri.TriangleVertexData[2] = TriangleVertexData[2];
-
-			Triangle Triangles[2];
-			int nTri = ClipTriangleAgainstNearPlane(&MyTri, Triangles);
-			for (int k = 0; k < nTri; k++)
-			{
-				Triangle Tri = Triangles[k];
-				for (int j = 0; j < 3; j++)
-				{
-					int OutPosX = Tri.Verts[j].x / Tri.Verts[j].w * (ViewportWidth / 2) + (ViewportWidth / 2) + ViewportX;
-					int OutPosY = Tri.Verts[j].y / Tri.Verts[j].w * (ViewportHeight / 2) + (ViewportHeight / 2) + ViewportY;
-					
-					TriangleCoords[j].x = OutPosX;
-					TriangleCoords[j].y = OutPosY;
-					TriangleCoords[j].z = Tri.Verts[j].z;
-					TriangleCoords[j].w = Tri.Verts[j].w;
-				}
-				DrawTriangle(TriangleCoords, Tri.TriangleVertexData);
-			}
-			free(TriangleVertexData[0].Data);
-			free(TriangleVertexData[1].Data);
-			free(TriangleVertexData[2].Data);
-			for (int k = 0; k < nTri; k++)
-			{
-				Triangle Tri = Triangles[k];
-				for (int _i = 0; _i < 3; _i++)
-				{
-					if (Tri.TriangleVertexData[_i].Data != TriangleVertexData[0].Data &&
-						Tri.TriangleVertexData[_i].Data != TriangleVertexData[1].Data &&
-						Tri.TriangleVertexData[_i].Data != TriangleVertexData[2].Data)
-						VectorFree(&Tri.TriangleVertexData[_i]);
-				}
-			}
-		}
+		// Nothing shaded for an instance outlives it
+		ArenaReset(DrawArena);
 	}
 }
 
-void glInit(GLsizei width, GLsizei height, void* ConstAddr, void* VarAddr, void* CodeAddr, void* IntConstAddr, void* TextureTableAddr)
+void glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	glDrawArraysInstanced(mode, first, count, 1);
+}
+
+// Allocates the attachments and tile maps of the default framebuffer, its depth format stays
+void DefaultFramebufferAlloc(GLsizei width, GLsizei height, GLenum format)
+{
+	Framebuffer* Target = DefaultFramebuffer;
+	Target->Width = width;
+	Target->Height = height;
+
+	Target->DepthAttachment = malloc(DepthFormatBytes(Target->DepthFormat) * width * height);
+
+	if (format != GL_BGRA && format != GL_RGB565 && format != GL_RGB) format = GL_RGBA;
+	Target->ColorFormat = format;
+	Target->ColorAttachment = malloc((format == GL_RGB565 ? 2 : 4) * width * height);
+
+	// Everything is damaged until the first present
+	Target->TilesX = (width + GL_DAMAGE_TILE_SIZE - 1) / GL_DAMAGE_TILE_SIZE;
+	Target->TilesY = (height + GL_DAMAGE_TILE_SIZE - 1) / GL_DAMAGE_TILE_SIZE;
+	Target->DamageTiles = (uint8_t*)malloc(Target->TilesX * Target->TilesY);
+	Target->ClearedTiles = (uint8_t*)malloc(Target->TilesX * Target->TilesY);
+	memset(Target->DamageTiles, 1, Target->TilesX * Target->TilesY);
+	memset(Target->ClearedTiles, 0, Target->TilesX * Target->TilesY);
+	Target->ClearedColor = 0;
+	Target->PendingTiles = (uint8_t*)malloc(Target->TilesX * Target->TilesY);
+	Target->PendingColors = (uint32_t*)malloc(4 * Target->TilesX * Target->TilesY);
+	Target->PendingDepths = (uint32_t*)malloc(4 * Target->TilesX * Target->TilesY);
+	memset(Target->PendingTiles, 0, Target->TilesX * Target->TilesY);
+}
+
+void DefaultFramebufferFree()
+{
+	free(DefaultFramebuffer->DepthAttachment);
+	free(DefaultFramebuffer->ColorAttachment);
+	free(DefaultFramebuffer->DamageTiles);
+	free(DefaultFramebuffer->ClearedTiles);
+	free(DefaultFramebuffer->PendingTiles);
+	free(DefaultFramebuffer->PendingColors);
+	free(DefaultFramebuffer->PendingDepths);
+}
+
+void glInit(GLsizei width, GLsizei height, GLenum format, GLenum depthformat, void* ConstAddr, void* VarAddr, void* CodeAddr, void* IntConstAddr, void* TextureTableAddr)
 {
-	GlobalFramebuffer = (Framebuffer*)malloc(sizeof(Framebuffer));
-	GlobalFramebuffer->Width = width;
-	GlobalFramebuffer->Height = height;
+	DefaultFramebuffer = (Framebuffer*)malloc(sizeof(Framebuffer));
+	GlobalFramebuffer = DefaultFramebuffer;
 
-	GlobalFramebuffer->DepthFormat = GL_FLOAT;
-	GlobalFramebuffer->DepthAttachment = malloc(sizeof(float) * width * height);
+	if (depthformat != GL_DEPTH_COMPONENT16 && depthformat != GL_DEPTH_COMPONENT24) depthformat = GL_DEPTH_COMPONENT;
+	DefaultFramebuffer->DepthFormat = depthformat;
+	DefaultFramebuffer->ColorTexture = 0;
+	DefaultFramebuffer->DepthRenderbuffer = 0;
+	DefaultFramebufferAlloc(width, height, format);
 
-	GlobalFramebuffer->ColorFormat = GL_RGBA;
-	GlobalFramebuffer->ColorAttachment = (uint32_t*)malloc(4 * width * height);
+	// Same defaults as GL, 2D drawing doesn't touch the depth buffer until GL_DEPTH_TEST is enabled
+	DepthTestEnabled = GL_FALSE;
+	DepthWriteEnabled = GL_TRUE;
+	DepthFunc = GL_LESS;
+	ClearDepthValue = 1.0f;
+
+	ViewportScale = 1.0f;
+
+	DrawArena = ArenaCreate(64 * 1024);
 
 	GlobalArrayBuffer = 0;
-	GlobalBuffers = NewVector(sizeof(Buffer*));
-	GlobalPrograms = NewVector(sizeof(Program*));
-	GlobalVertexArrays = NewVector(sizeof(VertexArray*));
+	GlobalBuffers = NewHandleTable();
+	GlobalPrograms = NewHandleTable();
+	GlobalVertexArrays = NewHandleTable();
 	GlobalShaders = NewVector(sizeof(RawShader*));
-	GlobalTextures = NewVector(sizeof(Texture2D*));
+	GlobalTextures = NewHandleTable();
+	GlobalFramebuffers = NewHandleTable();
+	GlobalRenderbuffers = NewHandleTable();
+	ActiveRenderbuffer = 0;
 	
 	GlobalConstStorage = NewVector(sizeof(CompConst));
 
@@ -5741,16 +7575,33 @@ void glInit(GLsizei width, GLsizei height, void* ConstAddr, void* VarAddr, void*
 	ActiveTextureUnit = 0;
 }
 
-uint32_t* glGetFramePtr()
+// The old contents are gone, everything is damaged again and undefined until cleared
+void glResizeFramebuffer(GLsizei width, GLsizei height, GLenum format)
+{
+	DefaultFramebufferFree();
+	DefaultFramebufferAlloc(width, height, format);
+}
+
+void* glGetFramePtr()
 {
-	return GlobalFramebuffer->ColorAttachment;
+	return DefaultFramebuffer->ColorAttachment;
 }
 
+// GLint has no room for a whole program handle next to the uniform index, a location keeps the program's slot
+// and the low bits of its generation. Locations of a deleted program stop resolving once its slot is reused.
+#define UNIFORM_INDEX_BITS 10
+#define UNIFORM_SLOT_BITS 10
+#define UNIFORM_GENERATION_MASK 0x7FF
+
 GLint glGetUniformLocation(GLuint program, const GLchar* name)
 {
 	Program* MyProgram;
 
-	VectorRead(&GlobalPrograms, &MyProgram, program - 1);
+	MyProgram = (Program*)HandleLookup(&GlobalPrograms, program);
+	if (!MyProgram) return -1;
+
+	int Slot = HandleIndex(program);
+	if (Slot >= (1 << UNIFORM_SLOT_BITS) || MyProgram->Uniforms.Size > (1 << UNIFORM_INDEX_BITS)) return -1;
 
 	for (int i = 0; i < MyProgram->Uniforms.Size; i++)
 	{
@@ -5760,23 +7611,48 @@ GLint glGetUniformLocation(GLuint program, const GLchar* name)
 
 		if (StringEquals(Uniform->Name, name))
 		{
-			return ((program - 1) << 16) | i;
+			uint32_t Generation = (program >> 16) & UNIFORM_GENERATION_MASK;
+			return (Generation << (UNIFORM_INDEX_BITS + UNIFORM_SLOT_BITS)) | (Slot << UNIFORM_INDEX_BITS) | i;
 		}
 	}
 
 	return -1;
 }
 
-volatile void glUniform1f(GLint location, GLfloat v0)
+// Uniform a location from glGetUniformLocation names, 0 for -1 and for locations that are stale or never were
+glslVariable* UniformLookup(GLint location)
 {
-	Program* MyProgram;
+	if (location == -1) return 0;
 
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
+	int Index = location & ((1 << UNIFORM_INDEX_BITS) - 1);
+	int Slot = (location >> UNIFORM_INDEX_BITS) & ((1 << UNIFORM_SLOT_BITS) - 1);
+	uint16_t Generation = ((uint32_t)location >> (UNIFORM_INDEX_BITS + UNIFORM_SLOT_BITS)) & UNIFORM_GENERATION_MASK;
 
-	glslExValue SetVal = { GLSL_FLOAT, v0 };
+	if (location < 0 || Slot >= GlobalPrograms.Slots.Size)
+	{
+		SWGL_STALE_HANDLE(location);
+		return 0;
+	}
+
+	HandleSlot* ProgramSlot = (HandleSlot*)GlobalPrograms.Slots.Data + Slot;
+	Program* MyProgram = (Program*)ProgramSlot->Object;
+	if (!MyProgram || (ProgramSlot->Generation & UNIFORM_GENERATION_MASK) != Generation || Index >= MyProgram->Uniforms.Size)
+	{
+		SWGL_STALE_HANDLE(location);
+		return 0;
+	}
+
+	glslVariable* Uniform;
+	VectorRead(&MyProgram->Uniforms, &Uniform, Index);
+	return Uniform;
+}
+
+volatile void glUniform1f(GLint location, GLfloat v0)
+{
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
+	glslExValue SetVal = { GLSL_FLOAT, v0 };
 
 	VerifyVar(MyUniform);
 
@@ -5785,15 +7661,11 @@ volatile void glUniform1f(GLint location, GLfloat v0)
 
 volatile void glUniform2f(GLint location, GLfloat v0, GLfloat v1)
 {
-	Program* MyProgram;
-
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
 	glslExValue SetVal = { GLSL_VEC2, v0, v1 };
 
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
-
 	VerifyVar(MyUniform);
 
 	AssignToExVal(MyUniform, SetVal);
@@ -5801,15 +7673,11 @@ volatile void glUniform2f(GLint location, GLfloat v0, GLfloat v1)
 
 volatile void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
 {
-	Program* MyProgram;
-
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
 	glslExValue SetVal = { GLSL_VEC3, v0, v1, v2 };
 
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
-
 	VerifyVar(MyUniform);
 
 	AssignToExVal(MyUniform, SetVal);
@@ -5817,15 +7685,11 @@ volatile void glUniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2)
 
 volatile void glUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
 {
-	Program* MyProgram;
-
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
 	glslExValue SetVal = { GLSL_VEC4, v0, v1, v2, v3 };
 
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
-
 	VerifyVar(MyUniform);
 
 	AssignToExVal(MyUniform, SetVal);
@@ -5833,15 +7697,11 @@ volatile void glUniform4f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GL
 
 volatile void glUniform1i(GLint location, GLint v0)
 {
-	Program* MyProgram;
-
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
 	glslExValue SetVal = { GLSL_INT, 0.0f, 0.0f, 0.0f, 0.0f, v0 };
 
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
-
 	VerifyVar(MyUniform);
 
 	AssignToExVal(MyUniform, SetVal);
@@ -5851,12 +7711,8 @@ volatile void glUniformMatrix2fv(GLint location, GLsizei count, GLboolean transp
 {
 	transpose = !transpose;
 
-	Program* MyProgram;
-
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
-
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
 	VerifyVar(MyUniform);
 
@@ -5874,12 +7730,8 @@ volatile void glUniformMatrix3fv(GLint location, GLsizei count, GLboolean transp
 {
 	transpose = !transpose;
 
-	Program* MyProgram;
-
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
-
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
 	VerifyVar(MyUniform);
 
@@ -5902,12 +7754,8 @@ volatile void glUniformMatrix4fv(GLint location, GLsizei count, GLboolean transp
 {
 	transpose = !transpose;
 
-	Program* MyProgram;
-
-	VectorRead(&GlobalPrograms, &MyProgram, location >> 16);
-
-	glslVariable* MyUniform;
-	VectorRead(&MyProgram->Uniforms, &MyUniform, location & 0xFFFF);
+	glslVariable* MyUniform = UniformLookup(location);
+	if (!MyUniform) return;
 
 	VerifyVar(MyUniform);
 
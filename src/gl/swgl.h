@@ -19,6 +19,15 @@ extern "C" {
 	const uint32_t GL_COLOR_BUFFER_BIT = 0b01;
 	const uint32_t GL_DEPTH_BUFFER_BIT = 0b10;
 
+	const uint32_t GL_MAP_READ_BIT = 0b1;
+	const uint32_t GL_MAP_WRITE_BIT = 0b10;
+	const uint32_t GL_MAP_INVALIDATE_RANGE_BIT = 0b100;
+	const uint32_t GL_MAP_INVALIDATE_BUFFER_BIT = 0b1000;
+	const uint32_t GL_MAP_UNSYNCHRONIZED_BIT = 0b10000;
+
+	// Side in pixels of the squares damage is tracked in
+	const uint32_t GL_DAMAGE_TILE_SIZE = 16;
+
 #define GL_TRUE 1
 #define GL_FALSE 0
 
@@ -32,6 +41,8 @@ extern "C" {
 	typedef char GLchar;
 	typedef uint8_t GLboolean;
 	typedef float GLfloat;
+	typedef int32_t GLintptr;
+	typedef int32_t GLsizeiptr;
 
 	/*
 	* ENUMS
@@ -52,15 +63,25 @@ extern "C" {
 		GL_FLOAT,
 		GL_INT,
 		GL_UNSIGNED_BYTE,
-
-		GL_DEPTH_COMPONENT,
+		GL_SHORT,
+		GL_UNSIGNED_SHORT,
+		GL_HALF_FLOAT,
+		GL_INT_2_10_10_10_REV, // Attributes only, x y z in 10 bits and w in 2, signed
+
+		GL_DEPTH_COMPONENT, // 32-bit float depth
+		GL_DEPTH_COMPONENT16,
+		GL_DEPTH_COMPONENT24, // Kept in a 32-bit word
 		GL_DEPTH_STENCIL,
 		GL_RED,
 		GL_RG,
 		GL_RGB,
 		GL_RGBA,
+		GL_BGRA, // Color attachment only, 0xAARRGGBB words like a 32bpp VBE mode
+		GL_RGB565, // Color attachment only, 16 bit words
 
 		GL_TRIANGLES,
+		GL_TRIANGLE_STRIP,
+		GL_TRIANGLE_FAN,
 		GL_POINTS,
 		GL_LINES,
 		GL_REPEAT,
@@ -70,6 +91,36 @@ extern "C" {
 		GL_TEXTURE_WRAP_S,
 		GL_TEXTURE_WRAP_T,
 
+		// Non standard, texel storage order picked with glTexParameteri before glTexImage2D
+		GL_TEXTURE_LAYOUT,
+		GL_TEXTURE_LAYOUT_LINEAR,
+		GL_TEXTURE_LAYOUT_TILED_4X4,
+		GL_TEXTURE_LAYOUT_TILED_8X8,
+
+		// Block compressed formats for glCompressedTexImage2D, 8 bytes per 4x4 block
+		GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, // BC1, RGB565 endpoints with 1-bit alpha
+		GL_COMPRESSED_RED_RGTC1, // BC4, single channel
+
+		GL_UNPACK_ROW_LENGTH,
+
+		GL_DEPTH_TEST,
+		GL_NEVER,
+		GL_LESS,
+		GL_EQUAL,
+		GL_LEQUAL,
+		GL_GREATER,
+		GL_NOTEQUAL,
+		GL_GEQUAL,
+		GL_ALWAYS,
+
+		GL_FRAMEBUFFER,
+		GL_RENDERBUFFER,
+		GL_COLOR_ATTACHMENT0, // A GL_RGBA texture, level 0
+		GL_DEPTH_ATTACHMENT, // A GL_DEPTH_COMPONENT renderbuffer
+		GL_FRAMEBUFFER_COMPLETE,
+		GL_FRAMEBUFFER_INCOMPLETE_ATTACHMENT,
+		GL_FRAMEBUFFER_INCOMPLETE_MISSING_ATTACHMENT,
+
 		GL_TEXTURE0,
 		GL_TEXTURE1,
 		GL_TEXTURE2,
@@ -84,8 +135,21 @@ extern "C" {
 	* NON-OPENGL HELPER FUNCTION DECLS
 	*/
 
-	void glInit(GLsizei width, GLsizei height, void* ConstAddr, void* VarAddr, void* CodeAddr, void* IntConstAddr, void* TextureTableAddr);
-	uint32_t* glGetFramePtr();
+	// format is the color attachment layout: GL_RGBA (0xRRGGBBAA words), GL_RGB, GL_BGRA or GL_RGB565.
+	// depthformat is GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT16 or GL_DEPTH_COMPONENT24.
+	void glInit(GLsizei width, GLsizei height, GLenum format, GLenum depthformat, void* ConstAddr, void* VarAddr, void* CodeAddr, void* IntConstAddr, void* TextureTableAddr);
+	void glResizeFramebuffer(GLsizei width, GLsizei height, GLenum format); // The framebuffer made by glInit
+	void* glGetFramePtr();
+
+	// Damage tracking, not part of GL. Rectangles are in framebuffer rows from the top, the tiles
+	// are GL_DAMAGE_TILE_SIZE squares written since the last glResetDamage, one byte each.
+	void glAddDamage(GLint x, GLint y, GLsizei width, GLsizei height);
+	const uint8_t* glGetDamageTiles(GLsizei* TilesX, GLsizei* TilesY);
+	void glResetDamage();
+
+	// Viewports and damage given while the framebuffer made by glInit is bound are multiplied by scale,
+	// so callers keep using display pixels when it's allocated smaller than the display
+	void glViewportScale(GLfloat scale);
 
 	/*
 	* SHADER FUNCTION DECLS
@@ -99,25 +163,31 @@ extern "C" {
 	GLuint glCreateProgram();
 	void glAttachShader(GLuint program, GLuint shader);
 	void glLinkProgram(GLuint program);
+	void glDeleteProgram(GLuint program);
 	void glUseProgram(GLuint program);
 
 	/*
 	* VERTEX ARRAY DECLS
 	*/
 
-	GLuint glGenVertexArrays(GLsizei n, GLuint* arrays); // Only supports 1 vertex array per call for now
+	GLuint glGenVertexArrays(GLsizei n, GLuint* arrays);
+	void glDeleteVertexArrays(GLsizei n, const GLuint* arrays);
 	void glBindVertexArray(GLuint array);
 	void glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+	void glVertexAttribDivisor(GLuint index, GLuint divisor);
 	void glEnableVertexAttribArray(GLuint index); // Doesn't do anything, here for backwards compatibility
 
 	/*
 	* BUFFER FUNCTION DECLS
 	*/
 
-	// Only supports 1 buffer per call for now
 	GLuint glGenBuffers(GLsizei n, GLuint* buffers);
+	void glDeleteBuffers(GLsizei n, const GLuint* buffers); // Storage stays alive while a vertex array attribute uses it
 	void glBindBuffer(GLenum type, GLuint buffer);
 	void glBufferData(GLenum target, GLsizei size, const void* data, GLenum usage);
+	void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+	void* glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLuint access);
+	GLboolean glUnmapBuffer(GLenum target);
 
 	/*
 	* DRAW FUNCTION DECLS
@@ -126,18 +196,46 @@ extern "C" {
 	void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
 	void glClear(GLuint flags);
 	void glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void glReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* data); // GL_RGBA, GL_UNSIGNED_BYTE, rows from the top
+
+	void glEnable(GLenum cap); // GL_DEPTH_TEST only
+	void glDisable(GLenum cap);
+	void glClearDepth(GLfloat depth);
+	void glDepthFunc(GLenum func);
+	void glDepthMask(GLboolean flag);
 
 	void glDrawArrays(GLenum mode, GLint first, GLsizei count);
+	void glDrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instancecount);
+
+	/*
+	* FRAMEBUFFER FUNCTION DECLS
+	*/
+
+	void glGenFramebuffers(GLsizei n, GLuint* framebuffers);
+	void glDeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+	void glBindFramebuffer(GLenum target, GLuint framebuffer); // 0 is the framebuffer made by glInit
+	void glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+	void glFramebufferRenderbuffer(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+	GLenum glCheckFramebufferStatus(GLenum target);
+
+	void glGenRenderbuffers(GLsizei n, GLuint* renderbuffers);
+	void glDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers);
+	void glBindRenderbuffer(GLenum target, GLuint renderbuffer);
+	void glRenderbufferStorage(GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
 
 	/*
 	* TEXTURE FUNCTION DECLS
 	*/
 
 	void glGenTextures(GLsizei n, GLuint* textures);
+	void glDeleteTextures(GLsizei n, const GLuint* textures);
 	void glActiveTexture(GLenum target);
 	void glBindTexture(GLenum target, GLuint texture);
 	void glTexParameteri(GLenum target, GLenum type, GLenum mode);
 	void glTexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* data);
+	void glCompressedTexImage2D(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void* data);
+	void glTexSubImage2D(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* data);
+	void glPixelStorei(GLenum pname, GLint param);
 	void glGenerateMipmap(GLenum target);
 
 	/*
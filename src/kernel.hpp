@@ -43,7 +43,25 @@ typedef struct {
 
 extern vesa_vbe_mode_info VbeModeInfo;
 
+// One entry of the BIOS memory map the bootloader collects
+typedef struct {
+	uint64_t base;
+	uint64_t length;
+	uint32_t type;			// E820_TYPE_*
+	uint32_t attributes;	// ACPI 3.0 extended attributes, not written by every BIOS
+} __attribute__ ((packed)) e820_entry;
+
+#define E820_TYPE_USABLE 1
+
+extern e820_entry E820Map[];
+extern uint16_t E820End;	// Address past the last entry of E820Map
+
 extern void* GlyphLabel;
 extern void* ImageLabel;
 
+// End of the loaded kernel image and bounds of .bss, from the linker
+extern void* OsEnd;
+extern void* BssStart;
+extern void* BssEnd;
+
 #endif // H_TOS_KERNEL
\ No newline at end of file
@@ -1,97 +1,315 @@
 #include "memory.hpp"
+#include "pmm.hpp"
 
-void memcpy(void *Destination_, const void *Source_, size_t N)
+/*
+* The heap is managed in 4 KB pages by a buddy allocator: a block of order n is 2^n pages, naturally aligned,
+* and freeing it merges it with its buddy (the block it was split from) while that one is free too, so both
+* directions take at most HEAP_MAX_ORDER steps. Requests up to 2 KB come from slabs instead, blocks of one
+* size class carved into equal objects with a free list threaded through the free ones.
+* The buddy allocator starts out empty and takes chunks of the largest order from the physical memory manager
+* when it runs out, chunks are never given back. Requests larger than a chunk get their own run of frames from
+* it and return them when freed.
+* Everything the allocator knows lives in HeapPages, one entry per physical page, never in the heap memory next
+* to an allocation. free looks the pointer's page up there to find out what it was.
+*/
+#define HEAP_PAGE_SIZE PMM_FRAME_SIZE
+#define HEAP_MAX_ORDER 10 // 4 MB chunks
+#define HEAP_NONE 0xFFFFFFFF
+
+#define HEAP_PAGE_NONE 0   // Not heap memory, or a page of a large allocation after its first
+#define HEAP_PAGE_INSIDE 1 // Not the first page of a block
+#define HEAP_PAGE_FREE 2   // First page of a free block
+#define HEAP_PAGE_BLOCK 3  // First page of an allocated block
+#define HEAP_PAGE_SLAB 4   // Any page of a slab
+#define HEAP_PAGE_LARGE 5  // First page of an allocation larger than a chunk
+
+// Size classes 16, 32, ... 2048 bytes
+#define SLAB_CLASSES 8
+#define SLAB_MIN_SHIFT 4
+#define SLAB_MAX_SIZE 2048
+// A slab holds at least this many objects
+#define SLAB_MIN_OBJECTS 8
+
+typedef struct
+{
+    uint8_t Kind;
+    uint8_t Order;
+    uint8_t Class;
+    uint16_t Used;
+    // Free list or partial slab list neighbours, as page indices
+    uint32_t Next;
+    uint32_t Prev;
+    // Slab pages: the slab's first page, and on that one the free objects. Large allocations: their page count.
+    uint32_t Head;
+    void* FreeObjects;
+} HeapPage;
+
+HeapPage* HeapPages;
+uint32_t HeapPageCount;
+uint32_t HeapFreeLists[HEAP_MAX_ORDER + 1];
+// Slabs of each class with at least one free object
+uint32_t SlabPartial[SLAB_CLASSES];
+uint8_t HeapReady;
+
+static inline void* HeapPageAddress(uint32_t Page)
+{
+    return (void*)(Page * HEAP_PAGE_SIZE);
+}
+
+static inline uint32_t HeapPageIndex(void* Address)
+{
+    return (uint32_t)Address / HEAP_PAGE_SIZE;
+}
+
+static void HeapListPush(uint32_t* List, uint32_t Page)
+{
+    HeapPages[Page].Prev = HEAP_NONE;
+    HeapPages[Page].Next = *List;
+    if (*List != HEAP_NONE) HeapPages[*List].Prev = Page;
+    *List = Page;
+}
+
+static void HeapListRemove(uint32_t* List, uint32_t Page)
+{
+    if (HeapPages[Page].Prev != HEAP_NONE) HeapPages[HeapPages[Page].Prev].Next = HeapPages[Page].Next;
+    else *List = HeapPages[Page].Next;
+    if (HeapPages[Page].Next != HEAP_NONE) HeapPages[HeapPages[Page].Next].Prev = HeapPages[Page].Prev;
+}
+
+static void HeapFreeBlock(uint32_t Page, uint8_t Order)
+{
+    HeapPages[Page].Kind = HEAP_PAGE_FREE;
+    HeapPages[Page].Order = Order;
+    HeapListPush(&HeapFreeLists[Order], Page);
+}
+
+// Smallest order whose blocks hold Bytes
+static uint8_t HeapOrderFor(size_t Bytes)
+{
+    uint8_t Order = 0;
+    while (Order <= HEAP_MAX_ORDER && ((size_t)HEAP_PAGE_SIZE << Order) < Bytes) Order++;
+    return Order;
+}
+
+// Adds a chunk from the physical memory manager as one free block of HEAP_MAX_ORDER, 0 when it has none left
+static uint8_t HeapGrow()
+{
+    uint32_t Address = PMM_AllocFrames(1 << HEAP_MAX_ORDER, 1 << HEAP_MAX_ORDER);
+    if (!Address) return 0;
+
+    uint32_t Page = HeapPageIndex((void*)Address);
+    for (uint32_t i = Page + 1;i < Page + (1 << HEAP_MAX_ORDER);i++) HeapPages[i].Kind = HEAP_PAGE_INSIDE;
+    HeapFreeBlock(Page, HEAP_MAX_ORDER);
+    return 1;
+}
+
+// First page of a free block of Order, split off a larger one when there's none. HEAP_NONE when out of memory.
+static uint32_t HeapAllocBlock(uint8_t Order)
 {
-    uint8_t *Destination = (uint8_t*)Destination_;
-    const uint8_t *Source = (uint8_t*)Source_;
-    while (N--) 
+    uint8_t From = Order;
+    while (From <= HEAP_MAX_ORDER && HeapFreeLists[From] == HEAP_NONE) From++;
+    if (From > HEAP_MAX_ORDER)
     {
-        *Destination++ = *Source++;
+        if (!HeapGrow()) return HEAP_NONE;
+        From = HEAP_MAX_ORDER;
     }
+
+    uint32_t Page = HeapFreeLists[From];
+    HeapListRemove(&HeapFreeLists[From], Page);
+
+    // The upper halves go back on the free lists
+    while (From > Order)
+    {
+        From--;
+        HeapFreeBlock(Page + (1 << From), From);
+    }
+
+    HeapPages[Page].Kind = HEAP_PAGE_BLOCK;
+    HeapPages[Page].Order = Order;
+    return Page;
 }
-void memset(void *Destination_, uint8_t Val, size_t N)
+
+static void HeapReleaseBlock(uint32_t Page, uint8_t Order)
 {
-    uint8_t *Destination = (uint8_t*)Destination_;
-    while (N--) 
+    while (Order < HEAP_MAX_ORDER)
     {
-        *Destination++ = Val;
+        uint32_t Buddy = Page ^ (1 << Order);
+        if (HeapPages[Buddy].Kind != HEAP_PAGE_FREE || HeapPages[Buddy].Order != Order) break;
+
+        HeapListRemove(&HeapFreeLists[Order], Buddy);
+        HeapPages[Buddy].Kind = HEAP_PAGE_INSIDE;
+        if (Buddy < Page) Page = Buddy;
+        Order++;
     }
+
+    HeapFreeBlock(Page, Order);
 }
 
-// Each page is 4 kb
-uint8_t Pages[1000000] = { 0 };
+static uint8_t SlabClassFor(size_t Bytes)
+{
+    uint8_t Class = 0;
+    while (((size_t)1 << (Class + SLAB_MIN_SHIFT)) < Bytes) Class++;
+    return Class;
+}
 
-void *malloc(size_t Bytes)
+// A new slab for Class, its objects all on its free list
+static uint32_t SlabCreate(uint8_t Class)
 {
-    size_t PageCount = Bytes / 4096 + 1; 
-    for (int i = 0;i < 1000000;i++)
+    size_t Size = (size_t)1 << (Class + SLAB_MIN_SHIFT);
+    uint8_t Order = HeapOrderFor(Size * SLAB_MIN_OBJECTS);
+    uint32_t Page = HeapAllocBlock(Order);
+    if (Page == HEAP_NONE) return HEAP_NONE;
+
+    for (uint32_t i = Page;i < Page + (1 << Order);i++)
+    {
+        HeapPages[i].Kind = HEAP_PAGE_SLAB;
+        HeapPages[i].Head = Page;
+    }
+
+    HeapPage* Head = &HeapPages[Page];
+    Head->Order = Order;
+    Head->Class = Class;
+    Head->Used = 0;
+    Head->FreeObjects = 0;
+
+    uint8_t* Base = (uint8_t*)HeapPageAddress(Page);
+    size_t Count = ((size_t)HEAP_PAGE_SIZE << Order) / Size;
+    for (size_t i = Count;i-- > 0;)
     {
-        if (!Pages[i])
-        {
-            uint8_t Found = 1;
-            for (int j = i;j < i + PageCount;j++)
-            {
-                if (Pages[j])
-                {
-                    i = j;
-                    Found = 0;
-                    break; 
-                }
-            }
-            if (Found)
-            {
-                for (int j = i;j < i + PageCount;j++)
-                {
-                    Pages[j] = 1;
-                }
-                *(volatile uint32_t*)(i * 4096 + 0x2000000) = Bytes;
-                return (void*)(i * 4096 + 0x2000000 + 4);
-            }
-        }
+        *(void**)(Base + i * Size) = Head->FreeObjects;
+        Head->FreeObjects = Base + i * Size;
     }
-    return (void*)0;
+
+    HeapListPush(&SlabPartial[Class], Page);
+    return Page;
 }
-void free(void *Buf)
+
+static void* SlabAlloc(uint8_t Class)
 {
-    size_t PageCount = *((volatile uint32_t*)Buf - 1) / 4096 + 1;
+    uint32_t Page = SlabPartial[Class];
+    if (Page == HEAP_NONE) Page = SlabCreate(Class);
+    if (Page == HEAP_NONE) return 0;
 
-    uint32_t Page = ((uint32_t)Buf - 0x2000004) / 4096;
+    HeapPage* Head = &HeapPages[Page];
+    void* Object = Head->FreeObjects;
+    Head->FreeObjects = *(void**)Object;
+    Head->Used++;
 
-    for (uint32_t i = Page;i < Page + PageCount;i++)
+    if (!Head->FreeObjects) HeapListRemove(&SlabPartial[Class], Page);
+    return Object;
+}
+
+static void SlabFree(uint32_t Page, void* Object)
+{
+    HeapPage* Head = &HeapPages[Page];
+    if (!Head->FreeObjects) HeapListPush(&SlabPartial[Head->Class], Page);
+
+    *(void**)Object = Head->FreeObjects;
+    Head->FreeObjects = Object;
+    Head->Used--;
+
+    // An empty slab goes back to the buddy allocator unless it's the only one of its class left
+    if (Head->Used == 0 && (Head->Prev != HEAP_NONE || Head->Next != HEAP_NONE))
     {
-        Pages[i] = 0;
+        HeapListRemove(&SlabPartial[Head->Class], Page);
+        for (uint32_t i = Page + 1;i < Page + (1 << Head->Order);i++) HeapPages[i].Kind = HEAP_PAGE_INSIDE;
+        HeapReleaseBlock(Page, Head->Order);
     }
 }
 
-void *memmove(void *dest, const void *src, size_t n)
+// Straight from the physical memory manager, Align in pages
+static void* HeapAllocLarge(size_t Bytes, uint32_t Align)
+{
+    uint32_t Count = (Bytes + HEAP_PAGE_SIZE - 1) / HEAP_PAGE_SIZE;
+    uint32_t Address = PMM_AllocFrames(Count, Align);
+    if (!Address) return 0;
+
+    HeapPage* Page = &HeapPages[HeapPageIndex((void*)Address)];
+    Page->Kind = HEAP_PAGE_LARGE;
+    Page->Head = Count;
+    return (void*)Address;
+}
+
+// Bytes usable at an allocated pointer
+static size_t HeapUsableSize(void* Buf)
+{
+    HeapPage* Page = &HeapPages[HeapPageIndex(Buf)];
+    if (Page->Kind == HEAP_PAGE_SLAB) return (size_t)1 << (HeapPages[Page->Head].Class + SLAB_MIN_SHIFT);
+    if (Page->Kind == HEAP_PAGE_LARGE) return (size_t)HEAP_PAGE_SIZE * Page->Head;
+    return (size_t)HEAP_PAGE_SIZE << Page->Order;
+}
+
+void *malloc(size_t Bytes)
+{
+    if (!HeapReady) allocInit();
+    if (Bytes == 0) Bytes = 1;
+
+    if (Bytes <= SLAB_MAX_SIZE) return SlabAlloc(SlabClassFor(Bytes));
+
+    uint8_t Order = HeapOrderFor(Bytes);
+    if (Order > HEAP_MAX_ORDER) return HeapAllocLarge(Bytes, 1);
+
+    uint32_t Page = HeapAllocBlock(Order);
+    return Page == HEAP_NONE ? 0 : HeapPageAddress(Page);
+}
+void free(void *Buf)
 {
-    uint8_t* from = (uint8_t*) src;
-    uint8_t* to = (uint8_t*) dest;
+    // Anything malloc didn't hand out is left alone
+    if (!HeapReady || HeapPageIndex(Buf) >= HeapPageCount) return;
 
-    if (from == to || n == 0)
-        return dest;
-    if (to > from && to-from < (int)n) {
-        /* to overlaps with from */
-        /*  <from......>         */
-        /*         <to........>  */
-        /* copy in reverse, to avoid overwriting from */
-        int i;
-        for(i=n-1; i>=0; i--)
-            to[i] = from[i];
-        return dest;
+    uint32_t Index = HeapPageIndex(Buf);
+    HeapPage* Page = &HeapPages[Index];
+
+    if (Page->Kind == HEAP_PAGE_SLAB)
+    {
+        uint32_t Offset = (uint32_t)Buf - (uint32_t)HeapPageAddress(Page->Head);
+        if (Offset % HeapUsableSize(Buf) == 0) SlabFree(Page->Head, Buf);
     }
-    if (from > to && from-to < (int)n) {
-        /* to overlaps with from */
-        /*        <from......>   */
-        /*  <to........>         */
-        /* copy forwards, to avoid overwriting from */
-        size_t i;
-        for(i=0; i<n; i++)
-            to[i] = from[i];
-        return dest;
+    else if (Page->Kind == HEAP_PAGE_BLOCK && Buf == HeapPageAddress(Index)) HeapReleaseBlock(Index, Page->Order);
+    else if (Page->Kind == HEAP_PAGE_LARGE && Buf == HeapPageAddress(Index))
+    {
+        Page->Kind = HEAP_PAGE_NONE;
+        PMM_FreeFrames((uint32_t)Buf, Page->Head);
     }
-    memcpy(dest, src, n);
-    return dest;
+}
+void *realloc(void *Buf, size_t Bytes)
+{
+    if (!Buf) return malloc(Bytes);
+    if (Bytes == 0)
+    {
+        free(Buf);
+        return 0;
+    }
+
+    // Like free, a pointer malloc didn't hand out has no entry to size it by
+    if (!HeapReady || HeapPageIndex(Buf) >= HeapPageCount) return 0;
+
+    size_t Usable = HeapUsableSize(Buf);
+    if (Bytes <= Usable) return Buf;
+
+    void* NewBuf = malloc(Bytes);
+    if (!NewBuf) return 0;
+
+    memcpy(NewBuf, Buf, Usable);
+    free(Buf);
+    return NewBuf;
+}
+void *calloc(size_t Count, size_t Size)
+{
+    if (Size && Count > (size_t)-1 / Size) return 0;
+
+    void* Buf = malloc(Count * Size);
+    if (Buf) memset(Buf, 0, Count * Size);
+    return Buf;
+}
+void *aligned_alloc(size_t Alignment, size_t Bytes)
+{
+    // Slab objects are aligned to their class size and blocks to theirs, asking for at least the alignment is enough
+    if (Bytes < Alignment) Bytes = Alignment;
+    if (HeapOrderFor(Bytes) <= HEAP_MAX_ORDER) return malloc(Bytes);
+
+    if (!HeapReady) allocInit();
+    return HeapAllocLarge(Bytes, Alignment > HEAP_PAGE_SIZE ? Alignment / HEAP_PAGE_SIZE : 1);
 }
 
 int  strlen(const char *s)
@@ -108,8 +326,23 @@ int  strlen(const char *s)
 
 void allocInit()
 {
-    for (int i = 0;i < 1000000;i++)
+    PMM_Init();
+
+    // One entry for every frame the physical memory manager can hand out, taken from it as well
+    HeapPageCount = PMM_FrameCount();
+    uint32_t Bytes = HeapPageCount * sizeof(HeapPage);
+    HeapPages = (HeapPage*)PMM_AllocFrames((Bytes + HEAP_PAGE_SIZE - 1) / HEAP_PAGE_SIZE, 1);
+
+    // Not even room for the table, nothing can ever be allocated. Stop here rather than zero low memory,
+    // with the size wanted in eax.
+    if (!HeapPages)
     {
-        Pages[i] = 0;
+        for (;;) asm volatile ("cli\nhlt" :: "a"(Bytes));
     }
+    memset(HeapPages, 0, Bytes); // HEAP_PAGE_NONE
+
+    for (int i = 0;i <= HEAP_MAX_ORDER;i++) HeapFreeLists[i] = HEAP_NONE;
+    for (int i = 0;i < SLAB_CLASSES;i++) SlabPartial[i] = HEAP_NONE;
+
+    HeapReady = 1;
 }
\ No newline at end of file
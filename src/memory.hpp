@@ -9,10 +9,14 @@ extern "C"
 {
 #endif // __cplusplus
 
+// memcpy, memset and memmove are in strops.cpp
 void  memcpy(void *Destination_, const void *Source_, size_t N);
 void  memset(void *Destination_, uint8_t Val, size_t N);
 void* malloc(size_t Bytes);
 void  free(void *Buf);
+void* realloc(void *Buf, size_t Bytes);
+void* calloc(size_t Count, size_t Size);
+void* aligned_alloc(size_t Alignment, size_t Bytes); // Alignment a power of two
 void* memmove(void *dest, const void *src, size_t n);
 int strlen(const char *s);
 void allocInit();
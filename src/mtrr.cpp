@@ -0,0 +1,146 @@
+#include "mtrr.hpp"
+
+#define MSR_MTRR_CAP       0xFE
+#define MSR_MTRR_DEF_TYPE  0x2FF
+#define MSR_MTRR_PHYSBASE0 0x200
+#define MSR_MTRR_PHYSMASK0 0x201
+
+#define MTRR_CAP_VCNT      0xFF
+#define MTRR_CAP_WC        (1 << 10)
+#define MTRR_DEF_ENABLE    (1 << 11)
+#define MTRR_MASK_VALID    (1 << 11)
+
+#define MTRR_MAX_BLOCKS    16
+#define MTRR_MAX_VARIABLE  32 // VCNT has 8 bits, CPUs have around 8 to 10
+
+typedef struct
+{
+    uint64_t Base;
+    uint64_t Size;
+    uint8_t Type;
+} MTRR_Block;
+
+static uint64_t MTRR_ReadMsr(uint32_t Msr)
+{
+    uint32_t Low, High;
+    asm volatile ("rdmsr" : "=a"(Low), "=d"(High) : "c"(Msr));
+    return ((uint64_t)High << 32) | Low;
+}
+
+static void MTRR_WriteMsr(uint32_t Msr, uint64_t Value)
+{
+    asm volatile ("wrmsr" :: "c"(Msr), "a"((uint32_t)Value), "d"((uint32_t)(Value >> 32)));
+}
+
+static void MTRR_Cpuid(uint32_t Leaf, uint32_t* A, uint32_t* D)
+{
+    uint32_t B, C;
+    asm volatile ("cpuid" : "=a"(*A), "=b"(B), "=c"(C), "=d"(*D) : "a"(Leaf), "c"(0));
+}
+
+uint8_t MTRR_IsSupported()
+{
+    uint32_t A, D;
+    MTRR_Cpuid(1, &A, &D);
+    if (!(D & (1 << 12))) return 0;
+
+    return (MTRR_ReadMsr(MSR_MTRR_CAP) & MTRR_CAP_WC) != 0;
+}
+
+// Width of physical addresses, the PHYSMASK registers hold bits 12 up to it
+static uint32_t MTRR_PhysicalBits()
+{
+    uint32_t A, D;
+    MTRR_Cpuid(0x80000000, &A, &D);
+    if (A < 0x80000008) return 36;
+
+    MTRR_Cpuid(0x80000008, &A, &D);
+    return A & 0xFF;
+}
+
+// Splits [Base, End) into naturally aligned power of two blocks, the largest that fit at the start of what's
+// left, each taking one MTRR. Returns 0 when there are more than MTRR_MAX_BLOCKS in all.
+static uint8_t MTRR_AddBlocks(MTRR_Block* Blocks, int* Count, uint64_t Base, uint64_t End, uint8_t Type)
+{
+    while (Base < End)
+    {
+        if (*Count == MTRR_MAX_BLOCKS) return 0;
+
+        uint64_t Block = Base ? (Base & -Base) : 0x100000000ull;
+        while (Block > End - Base) Block >>= 1;
+
+        Blocks[*Count].Base = Base;
+        Blocks[*Count].Size = Block;
+        Blocks[*Count].Type = Type;
+        (*Count)++;
+        Base += Block;
+    }
+    return 1;
+}
+
+uint8_t MTRR_SetRange(uint32_t Base, uint32_t Size, uint8_t Type)
+{
+    if (!MTRR_IsSupported()) return 0;
+
+    uint64_t Start = Base & ~0xFFF;
+    uint64_t End = Start + ((Size + 0xFFFull) & ~0xFFFull);
+
+    int Count = MTRR_ReadMsr(MSR_MTRR_CAP) & MTRR_CAP_VCNT;
+    if (Count > MTRR_MAX_VARIABLE) Count = MTRR_MAX_VARIABLE;
+    uint64_t AddressMask = ((uint64_t)1 << MTRR_PhysicalBits()) - 1;
+
+    // Where variable MTRRs overlap UC wins and most other pairs are undefined, so one of another type reaching
+    // into the range is freed and what it covered outside the range is set again. Free ones lack the valid bit.
+    MTRR_Block Blocks[MTRR_MAX_BLOCKS];
+    int BlockCount = 0;
+    int Free[MTRR_MAX_VARIABLE];
+    int FreeCount = 0;
+    for (int i = 0;i < Count;i++)
+    {
+        uint64_t PhysMask = MTRR_ReadMsr(MSR_MTRR_PHYSMASK0 + i * 2);
+        if (!(PhysMask & MTRR_MASK_VALID))
+        {
+            Free[FreeCount++] = i;
+            continue;
+        }
+
+        uint64_t PhysBase = MTRR_ReadMsr(MSR_MTRR_PHYSBASE0 + i * 2);
+        uint8_t OldType = PhysBase & 0xFF;
+        uint64_t OldMask = PhysMask & AddressMask & ~0xFFFull;
+        uint64_t OldStart = PhysBase & AddressMask & ~0xFFFull;
+        uint64_t OldEnd = OldStart + (OldMask & -OldMask);
+        if (OldType == Type || OldEnd <= Start || OldStart >= End) continue;
+
+        if (!MTRR_AddBlocks(Blocks, &BlockCount, OldStart, Start, OldType)) return 0;
+        if (!MTRR_AddBlocks(Blocks, &BlockCount, End, OldEnd, OldType)) return 0;
+        Free[FreeCount++] = i;
+    }
+
+    if (!MTRR_AddBlocks(Blocks, &BlockCount, Start, End, Type)) return 0;
+    if (FreeCount < BlockCount) return 0;
+
+    // The update sequence from the Intel SDM: no interrupts, caches off and flushed, MTRRs off while they change
+    uint32_t Flags, Cr0;
+    asm volatile ("pushf\npop %0\ncli" : "=r"(Flags));
+    asm volatile ("mov %%cr0, %0" : "=r"(Cr0));
+    asm volatile ("mov %0, %%cr0\nwbinvd" :: "r"((Cr0 | (1 << 30)) & ~(1 << 29)) : "memory");
+
+    uint64_t DefType = MTRR_ReadMsr(MSR_MTRR_DEF_TYPE);
+    MTRR_WriteMsr(MSR_MTRR_DEF_TYPE, DefType & ~(uint64_t)MTRR_DEF_ENABLE);
+
+    // The freed overlapping ones not reused must stop counting too
+    for (int i = 0;i < FreeCount;i++) MTRR_WriteMsr(MSR_MTRR_PHYSMASK0 + Free[i] * 2, 0);
+    for (int i = 0;i < BlockCount;i++)
+    {
+        uint64_t Mask = ~(Blocks[i].Size - 1) & AddressMask & ~(uint64_t)0xFFF;
+        MTRR_WriteMsr(MSR_MTRR_PHYSBASE0 + Free[i] * 2, Blocks[i].Base | Blocks[i].Type);
+        MTRR_WriteMsr(MSR_MTRR_PHYSMASK0 + Free[i] * 2, Mask | MTRR_MASK_VALID);
+    }
+
+    asm volatile ("wbinvd" ::: "memory");
+    MTRR_WriteMsr(MSR_MTRR_DEF_TYPE, DefType | MTRR_DEF_ENABLE);
+    asm volatile ("mov %0, %%cr0" :: "r"(Cr0) : "memory");
+    if (Flags & (1 << 9)) asm volatile ("sti");
+
+    return 1;
+}
@@ -0,0 +1,22 @@
+#ifndef H_TOS_MTRR
+#define H_TOS_MTRR
+
+#include <stdint.h>
+
+// Memory types of IA32_MTRR_PHYSBASEn
+#define MTRR_TYPE_UNCACHEABLE     0
+#define MTRR_TYPE_WRITE_COMBINING 1
+#define MTRR_TYPE_WRITE_THROUGH   4
+#define MTRR_TYPE_WRITE_PROTECT   5
+#define MTRR_TYPE_WRITE_BACK      6
+
+// 1 if the CPU has variable range MTRRs and they can be set to write-combining
+uint8_t MTRR_IsSupported();
+
+// Gives the physical range [Base, Base + Size) memory type Type. The range is split into naturally aligned
+// power of two blocks taking one variable MTRR each, Size is rounded up to 4 KB. MTRRs of another type that
+// overlap it, like a UC one over the PCI hole, are cut back to what lies outside the range. Returns 0 and
+// changes nothing when there aren't enough MTRRs for all that.
+uint8_t MTRR_SetRange(uint32_t Base, uint32_t Size, uint8_t Type);
+
+#endif // H_TOS_MTRR
@@ -2,6 +2,7 @@
 
 #include "kernel.hpp"
 #include "memory.hpp"
+#include "strops.hpp"
 #include "idt.hpp"
 #include "pic.hpp"
 #include "windowing.hpp"
@@ -17,6 +18,9 @@
 // APPLICATION INCLUDES
 #include "applications/cmd.hpp"
 #include "applications/GlTest.hpp"
+#include "applications/TexBench.hpp"
+#include "applications/LfbBench.hpp"
+#include "applications/MemBench.hpp"
 
 // OS DRIVER CODE STARTS HERE
 
@@ -33,11 +37,17 @@ keyboard Kbd = { 0 };
 
 Renderer Render;
 
+_Arena* FrameArena;
+
 extern "C" void kmain()
 {
-    memset((uint8_t*)0x1000000 + 0x7C00, 0, 100000);
+    memset(&BssStart, 0, (uint32_t)&BssEnd - (uint32_t)&BssStart);
+
+    StrOps_Init();
     
     allocInit();
+
+    FrameArena = ArenaCreate(256 * 1024);
     
     PIC_Init();
     PIC_SetMask(0xFFFF); // Disable all irqs
@@ -61,9 +71,15 @@ extern "C" void kmain()
 
     //WindowDescriptor* CmdWindow0 = App_GlTestNewWindow();
     //WindowDescriptor* CmdWindow1 = App_CmdNewWindow();
+    //WindowDescriptor* TexBenchWindow = App_TexBenchNewWindow();
+    //WindowDescriptor* LfbBenchWindow = App_LfbBenchNewWindow();
+    //WindowDescriptor* MemBenchWindow = App_MemBenchNewWindow();
 
     //Windowing.AddWindow(CmdWindow0);
     //Windowing.AddWindow(CmdWindow1);
+    //Windowing.AddWindow(TexBenchWindow);
+    //Windowing.AddWindow(LfbBenchWindow);
+    //Windowing.AddWindow(MemBenchWindow);
 
     //CmdWindow1->X = MouseX;
     //CmdWindow1->Y = MouseY;
@@ -84,6 +100,8 @@ extern "C" void kmain()
         Render.DrawCursor(MouseX, MouseY, 32, 48, 1.0f, 1.0f, 1.0f, 1.0f);
 
         Render.UpdateScreen();
+
+        ArenaReset(FrameArena);
     }
 }
 
@@ -0,0 +1,118 @@
+#include "pmm.hpp"
+#include "kernel.hpp"
+#include "memory.hpp"
+#include "drivers/bga/bga.hpp"
+
+// Frames of the 32 bit physical address space, the map's ranges above 4 GB are cut off
+#define PMM_MAX_FRAMES 0x100000
+#define PMM_LOW_MEMORY 0x100000
+
+// Frames assumed usable when the BIOS gave no map
+#define PMM_FALLBACK_START 0x100000
+#define PMM_FALLBACK_END   0x8000000
+
+// One bit per frame, set when the frame is used or isn't RAM
+uint32_t PMM_Bitmap[PMM_MAX_FRAMES / 32];
+uint32_t PMM_Frames;
+uint32_t PMM_Free;
+
+static inline uint8_t PMM_IsUsed(uint32_t Frame)
+{
+    return (PMM_Bitmap[Frame >> 5] >> (Frame & 31)) & 1;
+}
+
+static void PMM_MarkFrames(uint32_t First, uint32_t End, uint8_t Used)
+{
+    for (uint32_t Frame = First;Frame < End;Frame++)
+    {
+        if (Used) PMM_Bitmap[Frame >> 5] |= 1u << (Frame & 31);
+        else PMM_Bitmap[Frame >> 5] &= ~(1u << (Frame & 31));
+    }
+}
+
+// Usable ranges shrink to the whole frames inside them, reserved ones grow to every frame they touch
+static void PMM_MarkRange(uint64_t Base, uint64_t Length, uint8_t Used)
+{
+    uint64_t End = Base + Length;
+    if (End > (uint64_t)PMM_MAX_FRAMES * PMM_FRAME_SIZE) End = (uint64_t)PMM_MAX_FRAMES * PMM_FRAME_SIZE;
+    if (Base >= End) return;
+
+    uint32_t First = (uint32_t)(Used ? Base >> 12 : (Base + PMM_FRAME_SIZE - 1) >> 12);
+    uint32_t Last = (uint32_t)(Used ? (End + PMM_FRAME_SIZE - 1) >> 12 : End >> 12);
+    if (!Used && Last > PMM_Frames) PMM_Frames = Last;
+
+    PMM_MarkFrames(First, Last, Used);
+}
+
+void PMM_Init()
+{
+    memset(PMM_Bitmap, 0xFF, sizeof(PMM_Bitmap));
+    PMM_Frames = 0;
+
+    uint32_t Entries = ((uint32_t)E820End - (uint32_t)E820Map) / sizeof(e820_entry);
+
+    // Reserved entries win where the BIOS reports overlapping ranges
+    for (uint32_t i = 0;i < Entries;i++)
+    {
+        if (E820Map[i].type == E820_TYPE_USABLE) PMM_MarkRange(E820Map[i].base, E820Map[i].length, 0);
+    }
+    for (uint32_t i = 0;i < Entries;i++)
+    {
+        if (E820Map[i].type != E820_TYPE_USABLE) PMM_MarkRange(E820Map[i].base, E820Map[i].length, 1);
+    }
+
+    if (PMM_Frames == 0) PMM_MarkRange(PMM_FALLBACK_START, PMM_FALLBACK_END - PMM_FALLBACK_START, 0);
+
+    PMM_MarkRange(0, PMM_LOW_MEMORY, 1);
+    PMM_MarkRange(0, (uint32_t)&OsEnd, 1);
+    PMM_MarkRange((uint32_t)&BssStart, (uint32_t)&BssEnd - (uint32_t)&BssStart, 1);
+
+    // The framebuffer is usually above RAM and absent from the map, but nothing says it has to be
+    uint32_t VideoMemory = (uint32_t)VbeModeInfo.pitch * VbeModeInfo.height;
+    if (BGA_IsAvailable() && BGA_GetVideoMemory() > VideoMemory) VideoMemory = BGA_GetVideoMemory();
+    if (VbeModeInfo.framebuffer) PMM_MarkRange(VbeModeInfo.framebuffer, VideoMemory, 1);
+
+    PMM_Free = 0;
+    for (uint32_t Frame = 0;Frame < PMM_Frames;Frame++)
+    {
+        if (!PMM_IsUsed(Frame)) PMM_Free++;
+    }
+}
+
+uint32_t PMM_AllocFrames(uint32_t Count, uint32_t Align)
+{
+    for (uint32_t Frame = 0;Frame + Count <= PMM_Frames;Frame += Align)
+    {
+        uint32_t Run = 0;
+        while (Run < Count && !PMM_IsUsed(Frame + Run)) Run++;
+
+        if (Run == Count)
+        {
+            PMM_MarkFrames(Frame, Frame + Count, 1);
+            PMM_Free -= Count;
+            return Frame * PMM_FRAME_SIZE;
+        }
+
+        // No run can start before the used frame that ended this one
+        Frame = (Frame + Run) & ~(Align - 1);
+    }
+
+    return 0;
+}
+
+void PMM_FreeFrames(uint32_t Address, uint32_t Count)
+{
+    uint32_t First = Address / PMM_FRAME_SIZE;
+    PMM_MarkFrames(First, First + Count, 0);
+    PMM_Free += Count;
+}
+
+uint32_t PMM_FrameCount()
+{
+    return PMM_Frames;
+}
+
+uint32_t PMM_FreeFrameCount()
+{
+    return PMM_Free;
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef H_TOS_PMM
+#define H_TOS_PMM
+
+#include <stdint.h>
+
+#define PMM_FRAME_SIZE 4096
+
+// Builds the frame bitmap from the BIOS memory map: only usable RAM is free, minus the first megabyte (BIOS data,
+// the loaded kernel, VGA memory and ROMs), the kernel image, .bss and the linear framebuffer. Without a map
+// the range the heap used to assume, 1 MB to 128 MB, is taken as usable.
+void PMM_Init();
+
+// Physical address of Count contiguous free frames starting at a multiple of Align frames, a power of two.
+// 0 when there's no such run, frame 0 is never free.
+uint32_t PMM_AllocFrames(uint32_t Count, uint32_t Align);
+
+void PMM_FreeFrames(uint32_t Address, uint32_t Count);
+
+// Frames up to the end of the highest usable range, every frame PMM_AllocFrames can return is below it
+uint32_t PMM_FrameCount();
+
+uint32_t PMM_FreeFrameCount();
+
+#endif // H_TOS_PMM
\ No newline at end of file
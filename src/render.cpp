@@ -1,47 +1,767 @@
 #include "render.hpp"
 #include "kernel.hpp"
 #include "memory.hpp"
+#include "io.hpp"
+#include "drivers/bga/bga.hpp"
+#include "mtrr.hpp"
+#include "utils/bench.hpp"
 
 #define SWGL_FREESTANDING
 #include "gl/swgl.h"
 
+#include <tmmintrin.h>
+
 extern uint32_t RESX;
 extern uint32_t RESY;
 
-void DisplayBuffer(uint32_t* Buff)
+/*
+* swgl renders straight into the VBE mode's layout when it has one for it (BGRA for the usual 32bpp mode,
+* RGB565 for 16bpp) and presenting is then a plain copy. Any other mode gets 0xRRGGBBAA pixels, in memory
+* the bytes A B G R, and a row converter for the mode. Either way the row function is picked once and run
+* over every row, stepping the LFB by its pitch. Every path uses non-temporal stores, movntdq for 16 bytes and
+* movnti for single pixels: the LFB is only ever written, never read back, and keeping it out of the cache leaves
+* the cache to the renderer. Init maps the LFB write-combining with an MTRR, so those stores leave the CPU as
+* full line bursts instead of one bus write each. PresentWriteCombining is 0 when that wasn't possible.
+* Only the tiles swgl reports as damaged since the last present are converted, runs of damaged tiles in a
+* tile row are merged so each becomes one span per scanline.
+*/
+/*
+* With more than one buffer the frames go to stacked pages of video memory instead, and presenting flips the
+* display to the page just written by panning the BGA's virtual screen. Every page keeps its own damage map,
+* since the page being written last saw the frame from one or two presents ago.
+*/
+/*
+* swgl can render at a fraction of the display resolution, in eighths from half to full, picked every frame
+* to keep the frame time under a budget. Viewports and damage keep being given in display pixels, glViewportScale
+* maps them. Presenting then upscales: every display pixel takes its nearest framebuffer pixel, and at exactly
+* half the width each pixel is doubled with SSE unpacks. Text can stay at display resolution, it's drawn into
+* an overlay of display size instead and read back and laid over the upscaled rows as they're presented.
+*/
+#define PRESENT_MAX_BUFFERS 3
+
+#define RENDER_SCALE_MIN 4
+#define RENDER_SCALE_MAX 8
+// Frames a new scale is kept before it may change again
+#define RENDER_SCALE_HOLD 8
+
+typedef void (*PresentRowProc)(uint8_t* Dst, void* Src, int Count);
+
+PresentRowProc PresentRow;
+GLenum PresentFormat;
+int PresentSrcBytes;
+
+int PresentBuffers = 1;
+int PresentRequestedBuffers = 1;
+int PresentBackPage;
+uint8_t* PresentPageDamage[PRESENT_MAX_BUFFERS];
+
+uint8_t PresentWriteCombining;
+
+// Eighths of RESX x RESY swgl renders at
+int RenderScale = RENDER_SCALE_MAX;
+int RenderWidth;
+int RenderHeight;
+
+// Framebuffer column sampled by every display column, and the upscaled row being presented
+uint16_t* PresentScaleColumns;
+uint8_t* PresentScaleRow;
+
+// Frame time control, 0 cycles of budget leaves the scale alone
+uint32_t FrameCyclesPerMs;
+uint32_t FrameBudgetCycles;
+uint64_t FrameAverage; // 64 bit, a frame stalled past 2^32 cycles mustn't wrap back to a fast one
+uint64_t FrameLast;
+int FrameHold;
+
+// Text drawn at display resolution while the scale is below full. The rectangles are where text was drawn
+// this frame and the last one, in display pixels.
+typedef struct
+{
+    int X0;
+    int Y0;
+    int X1;
+    int Y1;
+} TextOverlayRect;
+
+#define TEXT_OVERLAY_MAX_RECTS 64
+
+uint8_t TextNative;
+GLuint TextOverlayFramebuffer;
+GLuint TextOverlayTexture;
+uint32_t* TextOverlayPixels;
+uint8_t* TextOverlayMask;
+uint8_t* TextOverlayRead;
+TextOverlayRect TextOverlayRects[TEXT_OVERLAY_MAX_RECTS];
+TextOverlayRect TextOverlayPrevRects[TEXT_OVERLAY_MAX_RECTS];
+int TextOverlayCount;
+int TextOverlayPrevCount;
+
+static inline void PresentStore(uint8_t* Dst, __m128i Value)
+{
+    if (((uint32_t)Dst & 15) == 0) _mm_stream_si128((__m128i*)Dst, Value);
+    else _mm_storeu_si128((__m128i*)Dst, Value);
+}
+
+// swgl already rendered in the mode's layout
+void PresentRowCopy(uint8_t* Dst, void* Src, int Count)
+{
+    uint8_t* In = (uint8_t*)Src;
+    int Size = Count * PresentSrcBytes;
+
+    int i = 0;
+    for (;i + 16 <= Size;i += 16)
+    {
+        PresentStore(Dst + i, _mm_loadu_si128((__m128i*)(In + i)));
+    }
+    if (((uint32_t)Dst & 3) == 0)
+    {
+        for (;i + 4 <= Size;i += 4) _mm_stream_si32((int*)(Dst + i), *(int*)(In + i));
+    }
+    for (;i < Size;i++) Dst[i] = In[i];
+}
+
+// 24bpp BGR. pshufb packs each group of 4 pixels into 12 bytes, and 4 groups are stitched into 3 full stores.
+void PresentRowBGR24(uint8_t* Dst, void* Row, int Count)
+{
+    uint32_t* Src = (uint32_t*)Row;
+    const __m128i Pack = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+
+    int i = 0;
+    for (;i + 16 <= Count;i += 16)
+    {
+        __m128i A = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(Src + i)), Pack);
+        __m128i B = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(Src + i + 4)), Pack);
+        __m128i C = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(Src + i + 8)), Pack);
+        __m128i D = _mm_shuffle_epi8(_mm_loadu_si128((__m128i*)(Src + i + 12)), Pack);
+
+        uint8_t* Out = Dst + i * 3;
+        PresentStore(Out, _mm_or_si128(A, _mm_slli_si128(B, 12)));
+        PresentStore(Out + 16, _mm_or_si128(_mm_srli_si128(B, 4), _mm_slli_si128(C, 8)));
+        PresentStore(Out + 32, _mm_or_si128(_mm_srli_si128(C, 8), _mm_slli_si128(D, 4)));
+    }
+    for (;i < Count;i++)
+    {
+        Dst[i * 3 + 0] = Src[i] >> 8;
+        Dst[i * 3 + 1] = Src[i] >> 16;
+        Dst[i * 3 + 2] = Src[i] >> 24;
+    }
+}
+
+// Any other direct color mode, 15/16bpp included, built pixel by pixel from the mode's masks and positions
+void PresentRowGeneric(uint8_t* Dst, void* Row, int Count)
+{
+    uint32_t* Src = (uint32_t*)Row;
+    int Bytes = (VbeModeInfo.bpp + 7) / 8;
+
+    for (int i = 0;i < Count;i++)
+    {
+        uint32_t R = (Src[i] >> 24) >> (8 - VbeModeInfo.red_mask);
+        uint32_t G = ((Src[i] >> 16) & 0xFF) >> (8 - VbeModeInfo.green_mask);
+        uint32_t B = ((Src[i] >> 8) & 0xFF) >> (8 - VbeModeInfo.blue_mask);
+        uint32_t Pixel = (R << VbeModeInfo.red_position) | (G << VbeModeInfo.green_position) | (B << VbeModeInfo.blue_position);
+
+        if (Bytes == 4) _mm_stream_si32((int*)(Dst + i * 4), Pixel);
+        else for (int j = 0;j < Bytes;j++) Dst[i * Bytes + j] = Pixel >> (j * 8);
+    }
+}
+
+// The swgl color format to render in, picked before glInit
+GLenum PresentSelectFormat()
+{
+    uint8_t Bpp = VbeModeInfo.bpp;
+    uint8_t R = VbeModeInfo.red_position;
+    uint8_t G = VbeModeInfo.green_position;
+    uint8_t B = VbeModeInfo.blue_position;
+    uint8_t EightBits = VbeModeInfo.red_mask == 8 && VbeModeInfo.green_mask == 8 && VbeModeInfo.blue_mask == 8;
+    uint8_t Bits565 = VbeModeInfo.red_mask == 5 && VbeModeInfo.green_mask == 6 && VbeModeInfo.blue_mask == 5;
+
+    if (EightBits && Bpp == 32 && R == 16 && G == 8 && B == 0) return GL_BGRA;
+    if (Bits565 && Bpp == 16 && R == 11 && G == 5 && B == 0) return GL_RGB565;
+    return GL_RGBA;
+}
+
+PresentRowProc PresentSelectRow()
+{
+    uint8_t Bpp = VbeModeInfo.bpp;
+    uint8_t R = VbeModeInfo.red_position;
+    uint8_t G = VbeModeInfo.green_position;
+    uint8_t B = VbeModeInfo.blue_position;
+    uint8_t EightBits = VbeModeInfo.red_mask == 8 && VbeModeInfo.green_mask == 8 && VbeModeInfo.blue_mask == 8;
+
+    if (PresentFormat != GL_RGBA) return &PresentRowCopy;
+    if (EightBits && Bpp == 32 && R == 24 && G == 16 && B == 8) return &PresentRowCopy;
+    if (EightBits && Bpp == 24 && R == 16 && G == 8 && B == 0) return &PresentRowBGR24;
+    return &PresentRowGeneric;
+}
+
+// Called after the display mode changed, picks the swgl color format and the row converter again
+void PresentModeChanged()
+{
+    PresentFormat = PresentSelectFormat();
+    PresentSrcBytes = PresentFormat == GL_RGB565 ? 2 : 4;
+    PresentRow = 0;
+}
+
+// Switches the display to Width x Height at 32bpp through the BGA and describes the new mode in VbeModeInfo,
+// which everything presenting reads. 0 without a BGA or when it refuses the mode, the boot mode stays then.
+uint8_t DisplaySetMode(uint32_t Width, uint32_t Height)
+{
+    uint32_t Framebuffer = BGA_GetFramebuffer();
+    if (!BGA_SetMode(Width, Height, 32)) return 0;
+
+    VbeModeInfo.width = Width;
+    VbeModeInfo.height = Height;
+    VbeModeInfo.bpp = 32;
+    VbeModeInfo.pitch = Width * 4;
+    VbeModeInfo.red_mask = 8;
+    VbeModeInfo.red_position = 16;
+    VbeModeInfo.green_mask = 8;
+    VbeModeInfo.green_position = 8;
+    VbeModeInfo.blue_mask = 8;
+    VbeModeInfo.blue_position = 0;
+    VbeModeInfo.reserved_mask = 8;
+    VbeModeInfo.reserved_position = 24;
+    if (Framebuffer) VbeModeInfo.framebuffer = Framebuffer;
+
+    RESX = Width;
+    RESY = Height;
+    return 1;
+}
+
+// Marks all of video memory write-combining, or the visible screen when the adapter doesn't say how much
+// there is. The LFB stays where it is across BGA modes, so this is done once.
+uint8_t DisplayMapWriteCombining()
+{
+    uint32_t Size = BGA_IsAvailable() ? BGA_GetVideoMemory() : 0;
+    if (!Size) Size = VbeModeInfo.pitch * VbeModeInfo.height;
+
+    return MTRR_SetRange(VbeModeInfo.framebuffer, Size, MTRR_TYPE_WRITE_COMBINING);
+}
+
+// Picks single, double or triple buffering. Returns the count actually used, fewer pages when
+// video memory can't hold that many and 1 without a BGA.
+int PresentSetBuffers(int Count)
+{
+    if (Count < 1) Count = 1;
+    if (Count > PRESENT_MAX_BUFFERS) Count = PRESENT_MAX_BUFFERS;
+    PresentRequestedBuffers = Count;
+
+    // Without room for three pages double buffering still beats tearing
+    uint8_t HasBga = BGA_IsAvailable();
+    if (!HasBga) Count = 1;
+    while (Count > 1 && BGA_GetVirtualHeight() < Count * VbeModeInfo.height) Count--;
+
+    GLsizei TilesX, TilesY;
+    glGetDamageTiles(&TilesX, &TilesY);
+
+    // A page nothing was presented to yet needs the whole frame
+    for (int i = 0;i < PRESENT_MAX_BUFFERS;i++)
+    {
+        if (PresentPageDamage[i]) free(PresentPageDamage[i]);
+        PresentPageDamage[i] = 0;
+        if (Count == 1 || i >= Count) continue;
+
+        PresentPageDamage[i] = (uint8_t*)malloc(TilesX * TilesY);
+        memset(PresentPageDamage[i], 1, TilesX * TilesY);
+    }
+
+    if (HasBga) BGA_SetYOffset(0);
+
+    PresentBuffers = Count;
+    PresentBackPage = Count > 1 ? 1 : 0;
+    return Count;
+}
+
+// Shows the page just written. Double buffering waits for vertical retrace so the page scanned out until
+// now isn't written while it's still on screen, with three pages the next one to write is already idle.
+void PresentFlip()
+{
+    if (PresentBuffers == 2)
+    {
+        while (IO_In8(0x3DA) & 8);
+        while (!(IO_In8(0x3DA) & 8));
+    }
+
+    BGA_SetYOffset(PresentBackPage * VbeModeInfo.height);
+    PresentBackPage = (PresentBackPage + 1) % PresentBuffers;
+}
+
+// Upscales Count display pixels from display column X of a framebuffer row into PresentScaleRow
+void PresentScaleRowBuild(uint8_t* Row, int X, int Count)
 {
-    uint8_t* VesaFramebuff = (uint8_t*)VbeModeInfo.framebuffer;
-    for (int i = 0;i < RESX * RESY;i++)
+    int i = 0;
+
+    // Exactly half the width, output pixels 2n and 2n + 1 are both framebuffer pixel n
+    if (RenderWidth * 2 == (int)RESX && (X & 1) == 0)
     {
-        VesaFramebuff[2] = (Buff[i] >> 24);
-        VesaFramebuff[1] = (Buff[i] >> 16) & 0xFF;
-        VesaFramebuff[0] = (Buff[i] >> 8) & 0xFF;
+        uint8_t* In = Row + (X / 2) * PresentSrcBytes;
+        if (PresentSrcBytes == 4)
+        {
+            for (;i + 8 <= Count;i += 8)
+            {
+                __m128i Pixels = _mm_loadu_si128((__m128i*)(In + i * 2));
+                _mm_storeu_si128((__m128i*)(PresentScaleRow + i * 4), _mm_unpacklo_epi32(Pixels, Pixels));
+                _mm_storeu_si128((__m128i*)(PresentScaleRow + i * 4 + 16), _mm_unpackhi_epi32(Pixels, Pixels));
+            }
+        }
+        else
+        {
+            for (;i + 16 <= Count;i += 16)
+            {
+                __m128i Pixels = _mm_loadu_si128((__m128i*)(In + i));
+                _mm_storeu_si128((__m128i*)(PresentScaleRow + i * 2), _mm_unpacklo_epi16(Pixels, Pixels));
+                _mm_storeu_si128((__m128i*)(PresentScaleRow + i * 2 + 16), _mm_unpackhi_epi16(Pixels, Pixels));
+            }
+        }
+    }
 
-        VesaFramebuff += 3;
+    if (PresentSrcBytes == 4)
+    {
+        for (;i < Count;i++) ((uint32_t*)PresentScaleRow)[i] = ((uint32_t*)Row)[PresentScaleColumns[X + i]];
+    }
+    else
+    {
+        for (;i < Count;i++) ((uint16_t*)PresentScaleRow)[i] = ((uint16_t*)Row)[PresentScaleColumns[X + i]];
     }
 }
 
+// Lays the overlay text of display row y over the upscaled display columns [X0, X1). Returns 1 if any landed.
+uint8_t TextOverlayComposite(int y, int X0, int X1)
+{
+    uint8_t Touched = 0;
+
+    for (int i = 0;i < TextOverlayCount;i++)
+    {
+        TextOverlayRect* Rect = &TextOverlayRects[i];
+        if (y < Rect->Y0 || y >= Rect->Y1) continue;
+
+        int From = Rect->X0 > X0 ? Rect->X0 : X0;
+        int To = Rect->X1 < X1 ? Rect->X1 : X1;
+        for (int x = From;x < To;x++)
+        {
+            int j = y * RESX + x;
+            if (!TextOverlayMask[j]) continue;
+
+            if (PresentSrcBytes == 4) ((uint32_t*)PresentScaleRow)[x - X0] = TextOverlayPixels[j];
+            else ((uint16_t*)PresentScaleRow)[x - X0] = TextOverlayPixels[j];
+            Touched = 1;
+        }
+    }
+
+    return Touched;
+}
+
+// Presents the display pixels whose nearest framebuffer pixel is in columns [X0, X1) of rows [Y0, Y1).
+// Display column x samples framebuffer column x * RenderWidth / RESX, rows alike.
+void PresentScaledSpan(uint8_t* Dst, uint8_t* Src, int X0, int Y0, int X1, int Y1, int Width, int Height)
+{
+    int OX0 = (X0 * RESX + RenderWidth - 1) / RenderWidth;
+    int OX1 = (X1 * RESX + RenderWidth - 1) / RenderWidth;
+    int OY0 = (Y0 * RESY + RenderHeight - 1) / RenderHeight;
+    int OY1 = (Y1 * RESY + RenderHeight - 1) / RenderHeight;
+    if (OX1 > Width) OX1 = Width;
+    if (OY1 > Height) OY1 = Height;
+    if (OX0 >= OX1) return;
+
+    int Bytes = (VbeModeInfo.bpp + 7) / 8;
+
+    // Display rows sampling the same framebuffer row reuse the upscaled row, unless text was laid over it
+    int Built = -1;
+    for (int y = OY0;y < OY1;y++)
+    {
+        int Row = y * RenderHeight / RESY;
+        if (Row != Built)
+        {
+            PresentScaleRowBuild(Src + Row * RenderWidth * PresentSrcBytes, OX0, OX1 - OX0);
+            Built = Row;
+        }
+        if (TextOverlayComposite(y, OX0, OX1)) Built = -1;
+
+        PresentRow(Dst + y * VbeModeInfo.pitch + OX0 * Bytes, PresentScaleRow, OX1 - OX0);
+    }
+}
+
+void DisplayBuffer(void* Buff)
+{
+    if (!PresentRow) PresentRow = PresentSelectRow();
+
+    uint8_t* Src = (uint8_t*)Buff;
+    uint8_t* VesaFramebuff = (uint8_t*)VbeModeInfo.framebuffer + PresentBackPage * VbeModeInfo.pitch * VbeModeInfo.height;
+    int Width = RESX < VbeModeInfo.width ? RESX : VbeModeInfo.width;
+    int Height = RESY < VbeModeInfo.height ? RESY : VbeModeInfo.height;
+
+    int Bytes = (VbeModeInfo.bpp + 7) / 8;
+    GLsizei TilesX, TilesY;
+    const uint8_t* Damage = glGetDamageTiles(&TilesX, &TilesY);
+
+    // The tiles are framebuffer tiles, while scaled their spans are upscaled to the display pixels they cover
+    uint8_t Scaled = RenderScale < RENDER_SCALE_MAX;
+    int SrcWidth = Scaled ? RenderWidth : Width;
+    int SrcHeight = Scaled ? RenderHeight : Height;
+
+    if (PresentBuffers > 1)
+    {
+        for (int i = 0;i < PresentBuffers;i++)
+        {
+            for (int j = 0;j < TilesX * TilesY;j++) PresentPageDamage[i][j] |= Damage[j];
+        }
+        Damage = PresentPageDamage[PresentBackPage];
+    }
+
+    for (int ty = 0;ty < TilesY;ty++)
+    {
+        int Y0 = ty * GL_DAMAGE_TILE_SIZE;
+        int Y1 = Y0 + GL_DAMAGE_TILE_SIZE < SrcHeight ? Y0 + GL_DAMAGE_TILE_SIZE : SrcHeight;
+
+        for (int tx = 0;tx < TilesX;tx++)
+        {
+            if (!Damage[ty * TilesX + tx]) continue;
+
+            int Run = tx;
+            while (tx + 1 < TilesX && Damage[ty * TilesX + tx + 1]) tx++;
+
+            int X0 = Run * GL_DAMAGE_TILE_SIZE;
+            int X1 = (tx + 1) * GL_DAMAGE_TILE_SIZE < SrcWidth ? (tx + 1) * GL_DAMAGE_TILE_SIZE : SrcWidth;
+            if (X0 >= X1) continue;
+
+            if (Scaled)
+            {
+                PresentScaledSpan(VesaFramebuff, Src, X0, Y0, X1, Y1, Width, Height);
+                continue;
+            }
+
+            for (int y = Y0;y < Y1;y++)
+            {
+                PresentRow(VesaFramebuff + y * VbeModeInfo.pitch + X0 * Bytes, Src + (y * RESX + X0) * PresentSrcBytes, X1 - X0);
+            }
+        }
+    }
+
+    glResetDamage();
+    if (PresentBuffers > 1) memset(PresentPageDamage[PresentBackPage], 0, TilesX * TilesY);
+
+    // Non-temporal stores aren't ordered with the rest, make them all visible before the next frame
+    _mm_sfence();
+
+    if (PresentBuffers > 1) PresentFlip();
+}
+
+// TSC cycles per millisecond, timed against 10 ms of PIT channel 2 counting down in one shot mode
+uint32_t FrameCalibrateTsc()
+{
+    // Gate on, speaker off
+    IO_Out8(0x61, (IO_In8(0x61) & ~0x02) | 0x01);
+
+    // 11932 ticks of the 1.193182 MHz input, counting starts once the count is written
+    IO_Out8(0x43, 0xB0);
+    IO_Out8(0x42, 11932 & 0xFF);
+    IO_Out8(0x42, 11932 >> 8);
+
+    uint64_t Start = BenchTimestamp();
+    while (!(IO_In8(0x61) & 0x20));
+    return (uint32_t)(BenchTimestamp() - Start) / 10;
+}
+
+// Reallocates the framebuffer at Scale eighths of the display, everything in it is lost and damaged.
+// Viewports set earlier were scaled by the old factor, the full screen one is set again.
+void RenderScaleApply(int Scale)
+{
+    RenderScale = Scale;
+    RenderWidth = RESX * Scale / RENDER_SCALE_MAX;
+    RenderHeight = RESY * Scale / RENDER_SCALE_MAX;
+
+    glResizeFramebuffer(RenderWidth, RenderHeight, PresentFormat);
+    glViewportScale(Scale / (float)RENDER_SCALE_MAX);
+    glViewport(0, 0, RESX, RESY);
+
+    if (PresentScaleColumns) free(PresentScaleColumns);
+    if (PresentScaleRow) free(PresentScaleRow);
+    PresentScaleColumns = (uint16_t*)malloc(RESX * sizeof(uint16_t));
+    PresentScaleRow = (uint8_t*)malloc(RESX * 4);
+    for (int x = 0;x < (int)RESX;x++) PresentScaleColumns[x] = x * RenderWidth / RESX;
+
+    // The tile maps changed size
+    PresentSetBuffers(PresentRequestedBuffers);
+}
+
+// Called once a frame. The average frame time decides the scale: above the budget it steps down, and it
+// steps up only when the next scale is predicted to stay under 90% of it. Frame time grows about with the
+// pixel count, so the prediction is the average times the pixel ratio, and the gap between the two
+// thresholds keeps the scale from bouncing between two steps.
+void RenderScaleUpdate()
+{
+    uint64_t Now = BenchTimestamp();
+    uint64_t Delta = Now - FrameLast;
+    FrameLast = Now;
+
+    if (!FrameBudgetCycles) return;
+
+    // Averaged over about 8 frames, a single slow frame doesn't move the scale
+    FrameAverage = FrameAverage - FrameAverage / 8 + Delta / 8;
+
+    if (FrameHold > 0)
+    {
+        FrameHold--;
+        return;
+    }
+
+    int Scale = RenderScale;
+    if (FrameAverage > FrameBudgetCycles)
+    {
+        if (Scale > RENDER_SCALE_MIN) Scale--;
+    }
+    else if (Scale < RENDER_SCALE_MAX)
+    {
+        float Growth = (Scale + 1) * (Scale + 1) / (float)(Scale * Scale);
+        if (FrameAverage * Growth < FrameBudgetCycles * 0.9f) Scale++;
+    }
+    if (Scale == RenderScale) return;
+
+    // Start the new scale from its predicted frame time rather than the old one's
+    FrameAverage = (uint64_t)(FrameAverage * (Scale * Scale) / (float)(RenderScale * RenderScale));
+    FrameHold = RENDER_SCALE_HOLD;
+    RenderScaleApply(Scale);
+}
+
+uint8_t TextOverlayActive()
+{
+    return TextNative && RenderScale < RENDER_SCALE_MAX;
+}
+
+// The overlay is a display sized texture behind a framebuffer object, transparent wherever no text is
+void TextOverlayCreate()
+{
+    glGenTextures(1, &TextOverlayTexture);
+    glBindTexture(GL_TEXTURE_2D, TextOverlayTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, RESX, RESY, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+
+    glGenFramebuffers(1, &TextOverlayFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, TextOverlayFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, TextOverlayTexture, 0);
+
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glViewport(0, 0, RESX, RESY);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    TextOverlayPixels = (uint32_t*)malloc(RESX * RESY * 4);
+    TextOverlayMask = (uint8_t*)malloc(RESX * RESY);
+    TextOverlayRead = (uint8_t*)malloc(RESX * RESY * 4);
+}
+
+void TextOverlayFree()
+{
+    if (!TextOverlayFramebuffer) return;
+
+    glDeleteFramebuffers(1, &TextOverlayFramebuffer);
+    glDeleteTextures(1, &TextOverlayTexture);
+    free(TextOverlayPixels);
+    free(TextOverlayMask);
+    free(TextOverlayRead);
+
+    TextOverlayFramebuffer = 0;
+    TextOverlayTexture = 0;
+    TextOverlayCount = 0;
+    TextOverlayPrevCount = 0;
+}
+
+// Directs the following draws to the overlay, at display resolution
+void TextOverlayBegin()
+{
+    if (!TextOverlayFramebuffer) TextOverlayCreate();
+    glBindFramebuffer(GL_FRAMEBUFFER, TextOverlayFramebuffer);
+}
+
+// Back to the framebuffer, [X0, X1) x [Y0, Y1) of the overlay was drawn to
+void TextOverlayEnd(float X0, float Y0, float X1, float Y1)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, RESX, RESY);
+
+    TextOverlayRect Rect;
+    Rect.X0 = X0 > 0.0f ? (int)X0 : 0;
+    Rect.Y0 = Y0 > 0.0f ? (int)Y0 : 0;
+    Rect.X1 = X1 < (float)RESX ? (int)X1 + 1 : RESX;
+    Rect.Y1 = Y1 < (float)RESY ? (int)Y1 + 1 : RESY;
+    if (Rect.X1 > (int)RESX) Rect.X1 = RESX;
+    if (Rect.Y1 > (int)RESY) Rect.Y1 = RESY;
+    if (Rect.X0 >= Rect.X1 || Rect.Y0 >= Rect.Y1) return;
+
+    // Past the last slot everything is merged into it
+    if (TextOverlayCount < TEXT_OVERLAY_MAX_RECTS)
+    {
+        TextOverlayRects[TextOverlayCount++] = Rect;
+        return;
+    }
+
+    TextOverlayRect* Last = &TextOverlayRects[TEXT_OVERLAY_MAX_RECTS - 1];
+    if (Rect.X0 < Last->X0) Last->X0 = Rect.X0;
+    if (Rect.Y0 < Last->Y0) Last->Y0 = Rect.Y0;
+    if (Rect.X1 > Last->X1) Last->X1 = Rect.X1;
+    if (Rect.Y1 > Last->Y1) Last->Y1 = Rect.Y1;
+}
+
+// Overlay bytes R G B A to the layout swgl renders the framebuffer in
+uint32_t TextOverlayPack(const uint8_t* Pixel)
+{
+    uint32_t R = Pixel[0];
+    uint32_t G = Pixel[1];
+    uint32_t B = Pixel[2];
+    uint32_t A = Pixel[3];
+
+    if (PresentFormat == GL_BGRA) return (A << 24) | (R << 16) | (G << 8) | B;
+    if (PresentFormat == GL_RGB565) return ((R >> 3) << 11) | ((G >> 2) << 5) | (B >> 3);
+    return (R << 24) | (G << 16) | (B << 8) | A;
+}
+
+// Before presenting: reads this frame's text back from the overlay, and damages where text is now and where
+// it was last frame so both get presented again. Pixels at least half opaque replace the upscaled ones.
+void TextOverlayResolve()
+{
+    if (TextOverlayCount)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, TextOverlayFramebuffer);
+
+        for (int i = 0;i < TextOverlayCount;i++)
+        {
+            TextOverlayRect* Rect = &TextOverlayRects[i];
+            int Width = Rect->X1 - Rect->X0;
+            int Height = Rect->Y1 - Rect->Y0;
+            glReadPixels(Rect->X0, Rect->Y0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, TextOverlayRead);
+
+            uint8_t* In = TextOverlayRead;
+            for (int y = Rect->Y0;y < Rect->Y1;y++)
+            {
+                for (int x = Rect->X0;x < Rect->X1;x++)
+                {
+                    TextOverlayMask[y * RESX + x] = In[3] >= 128;
+                    TextOverlayPixels[y * RESX + x] = TextOverlayPack(In);
+                    In += 4;
+                }
+            }
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    for (int i = 0;i < TextOverlayCount;i++)
+    {
+        TextOverlayRect* Rect = &TextOverlayRects[i];
+        glAddDamage(Rect->X0, Rect->Y0, Rect->X1 - Rect->X0, Rect->Y1 - Rect->Y0);
+    }
+    for (int i = 0;i < TextOverlayPrevCount;i++)
+    {
+        TextOverlayRect* Rect = &TextOverlayPrevRects[i];
+        glAddDamage(Rect->X0, Rect->Y0, Rect->X1 - Rect->X0, Rect->Y1 - Rect->Y0);
+    }
+}
+
+// After presenting: clears this frame's text out of the overlay, it's where last frame's text was from now on
+void TextOverlayReset()
+{
+    if (TextOverlayCount)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, TextOverlayFramebuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+        for (int i = 0;i < TextOverlayCount;i++)
+        {
+            TextOverlayRect* Rect = &TextOverlayRects[i];
+            glViewport(Rect->X0, Rect->Y0, Rect->X1 - Rect->X0, Rect->Y1 - Rect->Y0);
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, RESX, RESY);
+    }
+
+    memcpy(TextOverlayPrevRects, TextOverlayRects, TextOverlayCount * sizeof(TextOverlayRect));
+    TextOverlayPrevCount = TextOverlayCount;
+    TextOverlayCount = 0;
+}
+
 static const char* BGFragShaderSource = "out vec4 OutColor;\nin vec3 FragColor;\nint main(){\nOutColor = vec4(FragColor.x, FragColor.y, FragColor.z, 1.0);\n}";
 static const char* BGVertexShaderSource = "layout(location = 0) vec3 InPos;\nlayout(location = 1) vec3 InCol;\nout vec3 FragColor;\nuniform float Tick;\nint main(){\ngl_Position = vec4(cos(Tick) + InPos.x, sin(Tick) + InPos.y, InPos.z, 1.0);FragColor = InCol;}";
 static const char* GlyphFragShaderSource = "out vec4 OutColor;\nin vec2 UV;\nuniform vec4 Color;\nuniform sampler2D Glyph;\nint main(){\nOutColor = texture(Glyph, UV) * Color;}";
-static const char* GlyphVertexShaderSource = "layout(location = 0) vec3 InPos;\nlayout(location = 1) vec2 InUV;\nout vec2 UV;\nint main(){\ngl_Position = vec4(InPos.x, InPos.y, InPos.z, 1.0);UV = InUV;}";
+static const char* GlyphVertexShaderSource = "layout(location = 0) vec2 InPos;\nlayout(location = 1) vec2 InUV;\nout vec2 UV;\nint main(){\ngl_Position = vec4(InPos.x * 2.0, InPos.y * 2.0, 0.0, 1.0);UV = InUV;}";
 
 GLuint BGFragShader, BGVertShader, GlyphFragShader, GlyphVertShader;
 GLuint BGProgram, GlyphProgram;
 
 GLuint BGVAO, BGVBO;
 GLuint GlyphVAO, GlyphVBO;
+GLuint GlyphBatchVAO, GlyphBatchVBO;
+GLint GlyphSamplerLoc, GlyphColorLoc;
+
+// All glyphs live in one 16x16 grid of 80x160 cells so a whole string can be drawn with one texture bound.
+#define GLYPH_CELL_WIDTH 80
+#define GLYPH_CELL_HEIGHT 160
+#define GLYPH_ATLAS_COLUMNS 16
+#define GLYPH_ATLAS_ROWS 16
+#define GLYPH_COUNT 254
+#define GLYPH_BLOCK_BYTES 8
+
+GLuint GlyphAtlasTexture;
+GlyphMetrics Glyphs[256];
+
+// Glyph quads are 8 byte vertices instead of 5 floats. The position is a normalized short holding half the
+// NDC coordinate, so glyphs hanging up to a screen off the edge still fit, and the shader doubles it again.
+// The uv is a normalized unsigned short.
+typedef struct
+{
+    int16_t X;
+    int16_t Y;
+    uint16_t U;
+    uint16_t V;
+} GlyphVertex;
+
+// CPU side vertex batch for text, 6 vertices per glyph
+GlyphVertex* GlyphBatch;
+int GlyphBatchCap;
+int GlyphBatchCount;
+
+// Screen pixel bounds of the glyphs in the batch
+float GlyphBatchX0, GlyphBatchY0, GlyphBatchX1, GlyphBatchY1;
+
+// Flushed batches stream through GlyphBatchVBO as a ring. Each flush goes after the previous one and the
+// buffer is only orphaned when it wraps, so the per frame text uploads never allocate.
+#define GLYPH_STREAM_VERTICES (6 * 1024)
+int GlyphStreamHead;
 
-GLuint GlyphTextures[256];
 GLuint CursorTexture;
 
 float BGTick;
 
+void GlyphVertexPack(GlyphVertex* Vertex, float x, float y, float u, float v)
+{
+    x = x * 0.5f;
+    y = y * 0.5f;
+    if (x < -1.0f) x = -1.0f;
+    if (x > 1.0f) x = 1.0f;
+    if (y < -1.0f) y = -1.0f;
+    if (y > 1.0f) y = 1.0f;
+
+    Vertex->X = (int16_t)(x * 32767.0f + (x < 0.0f ? -0.5f : 0.5f));
+    Vertex->Y = (int16_t)(y * 32767.0f + (y < 0.0f ? -0.5f : 0.5f));
+    Vertex->U = (uint16_t)(u * 65535.0f + 0.5f);
+    Vertex->V = (uint16_t)(v * 65535.0f + 0.5f);
+}
+
 volatile void Renderer::Init()
 {
-    glInit(RESX, RESY, malloc(100000), malloc(100000), malloc(100000), malloc(100000), malloc(10000));
+    // The boot mode is 24bpp, with a BGA the same resolution at 32bpp presents without converting
+    DisplaySetMode(RESX, RESY);
+    PresentModeChanged();
+    PresentWriteCombining = DisplayMapWriteCombining();
+    glInit(RESX, RESY, PresentFormat, GL_DEPTH_COMPONENT16, malloc(100000), malloc(100000), malloc(100000), malloc(100000), malloc(10000));
     glViewport(0, 0, RESX, RESY);
 
+    RenderScale = RENDER_SCALE_MAX;
+    RenderWidth = RESX;
+    RenderHeight = RESY;
+
+    SetPresentBuffers(3);
+
     BGTick = 0.5f;
 
     BGVertShader = glCreateShader(GL_VERTEX_SHADER);
@@ -72,6 +792,9 @@ volatile void Renderer::Init()
 
     glLinkProgram(GlyphProgram);
 
+    GlyphSamplerLoc = glGetUniformLocation(GlyphProgram, "Glyph");
+    GlyphColorLoc = glGetUniformLocation(GlyphProgram, "Color");
+
     glGenVertexArrays(1, &BGVAO);
     glGenBuffers(1, &BGVBO);
 
@@ -95,28 +818,87 @@ volatile void Renderer::Init()
     glBindVertexArray(GlyphVAO);
     glBindBuffer(GL_ARRAY_BUFFER, GlyphVBO);
 
+    // Drawn as a triangle strip
     float Glyphvertices[] = {
-        -1.0f, 1.0f, 0.0f, 0.0f, 0.0f,
-        1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-        -1.0f, -1.0f, 0.0f, 0.0f, 1.0f,
-        1.0f, -1.0f, 0.0f, 1.0f, 1.0f,
-        1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-        -1.0f, -1.0f, 0.0f, 0.0f, 1.0f
+        -1.0f, 1.0f, 0.0f, 0.0f,
+        1.0f, 1.0f, 1.0f, 0.0f,
+        -1.0f, -1.0f, 0.0f, 1.0f,
+        1.0f, -1.0f, 1.0f, 1.0f
     };
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Glyphvertices), Glyphvertices, GL_STATIC_DRAW);
+    GlyphVertex GlyphQuad[4];
+    for (int i = 0;i < 4;i++)
+    {
+        GlyphVertexPack(&GlyphQuad[i], Glyphvertices[i * 4], Glyphvertices[i * 4 + 1], Glyphvertices[i * 4 + 2], Glyphvertices[i * 4 + 3]);
+    }
+
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GlyphQuad), GlyphQuad, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 2, GL_SHORT, GL_TRUE, sizeof(GlyphVertex), (void*)0);
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(GlyphVertex), (void*)(2 * sizeof(int16_t)));
+
+    glGenVertexArrays(1, &GlyphBatchVAO);
+    glGenBuffers(1, &GlyphBatchVBO);
+
+    glBindVertexArray(GlyphBatchVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, GlyphBatchVBO);
+
+    glBufferData(GL_ARRAY_BUFFER, GLYPH_STREAM_VERTICES * sizeof(GlyphVertex), 0, GL_STREAM_DRAW);
+    GlyphStreamHead = 0;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(0, 2, GL_SHORT, GL_TRUE, sizeof(GlyphVertex), (void*)0);
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(GlyphVertex), (void*)(2 * sizeof(int16_t)));
 
-    for (int i = 0;i < 255;i++)
+    int AtlasWidth = GLYPH_CELL_WIDTH * GLYPH_ATLAS_COLUMNS;
+    int AtlasHeight = GLYPH_CELL_HEIGHT * GLYPH_ATLAS_ROWS;
+
+    // glyphs.bin holds every glyph as rows of BC1 blocks (see build_resources.py), so the atlas is
+    // put together block row by block row and never expanded to RGBA
+    int AtlasBlocksWide = AtlasWidth / 4;
+    int AtlasSize = AtlasBlocksWide * (AtlasHeight / 4) * GLYPH_BLOCK_BYTES;
+    uint8_t* AtlasBlocks = (uint8_t*)malloc(AtlasSize);
+
+    // Empty cells get fully transparent blocks
+    for (int i = 0;i < AtlasSize;i += GLYPH_BLOCK_BYTES)
     {
-        glGenTextures(1, &GlyphTextures[i]);
-        glBindTexture(GL_TEXTURE_2D, GlyphTextures[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 80, 160, 0, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t*)(&GlyphLabel) + i * 80 * 160 * 4);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        memset(AtlasBlocks + i, 0, 4);
+        memset(AtlasBlocks + i + 4, 0xFF, 4);
     }
 
+    memset(Glyphs, 0, sizeof(Glyphs));
+
+    // Glyph 0 isn't in glyphs.bin, so letter i is stored at index i - 1
+    for (int i = 1;i <= GLYPH_COUNT;i++)
+    {
+        int CellX = (i % GLYPH_ATLAS_COLUMNS) * GLYPH_CELL_WIDTH;
+        int CellY = (i / GLYPH_ATLAS_COLUMNS) * GLYPH_CELL_HEIGHT;
+        int CellRowBytes = GLYPH_CELL_WIDTH / 4 * GLYPH_BLOCK_BYTES;
+        uint8_t* Src = (uint8_t*)(&GlyphLabel) + (i - 1) * CellRowBytes * (GLYPH_CELL_HEIGHT / 4);
+
+        for (int y = 0;y < GLYPH_CELL_HEIGHT / 4;y++)
+        {
+            memcpy(AtlasBlocks + ((CellY / 4 + y) * AtlasBlocksWide + CellX / 4) * GLYPH_BLOCK_BYTES, Src + y * CellRowBytes, CellRowBytes);
+        }
+
+        Glyphs[i].U0 = CellX / (float)AtlasWidth;
+        Glyphs[i].V0 = CellY / (float)AtlasHeight;
+        Glyphs[i].U1 = (CellX + GLYPH_CELL_WIDTH) / (float)AtlasWidth;
+        Glyphs[i].V1 = (CellY + GLYPH_CELL_HEIGHT) / (float)AtlasHeight;
+        // build_resources.py stretches every glyph to the full cell, so they all advance by one cell width
+        Glyphs[i].Advance = GLYPH_CELL_WIDTH / (float)GLYPH_CELL_HEIGHT;
+    }
+
+    glGenTextures(1, &GlyphAtlasTexture);
+    glBindTexture(GL_TEXTURE_2D, GlyphAtlasTexture);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, AtlasWidth, AtlasHeight, 0, AtlasSize, AtlasBlocks);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    free(AtlasBlocks);
+
+    GlyphBatchCap = 256;
+    GlyphBatchCount = 0;
+    GlyphBatch = (GlyphVertex*)malloc(GlyphBatchCap * 6 * sizeof(GlyphVertex));
+
     glGenTextures(1, &CursorTexture);
     glBindTexture(GL_TEXTURE_2D, CursorTexture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 32, 48, 0, GL_RGBA, GL_UNSIGNED_BYTE, (uint8_t*)(&ImageLabel));
@@ -141,25 +923,128 @@ volatile void Renderer::DrawBackground()
 
     glDrawArrays(GL_TRIANGLES, 0, 3);
 }
-volatile void Renderer::DrawLetter(uint8_t letter, float x, float y, float width, float height, float red, float green, float blue, float alpha)
+void GlyphBatchPushVertex(GlyphVertex* Vertex, float x, float y, float u, float v)
+{
+    // Screen pixels (origin top left) to NDC of the full screen viewport
+    GlyphVertexPack(Vertex, x / (RESX / 2) - 1.0f, 1.0f - y / (RESY / 2), u, v);
+}
+
+void GlyphBatchPush(uint8_t letter, float x, float y, float width, float height)
+{
+    if (GlyphBatchCount >= GlyphBatchCap)
+    {
+        GlyphVertex* NewBatch = (GlyphVertex*)malloc(GlyphBatchCap * 2 * 6 * sizeof(GlyphVertex));
+        memcpy(NewBatch, GlyphBatch, GlyphBatchCount * 6 * sizeof(GlyphVertex));
+        free(GlyphBatch);
+        GlyphBatch = NewBatch;
+        GlyphBatchCap *= 2;
+    }
+
+    GlyphMetrics* Glyph = &Glyphs[letter];
+    GlyphVertex* Quad = GlyphBatch + GlyphBatchCount * 6;
+
+    if (GlyphBatchCount == 0 || x < GlyphBatchX0) GlyphBatchX0 = x;
+    if (GlyphBatchCount == 0 || y < GlyphBatchY0) GlyphBatchY0 = y;
+    if (GlyphBatchCount == 0 || x + width > GlyphBatchX1) GlyphBatchX1 = x + width;
+    if (GlyphBatchCount == 0 || y + height > GlyphBatchY1) GlyphBatchY1 = y + height;
+
+    GlyphBatchPushVertex(Quad + 0, x, y, Glyph->U0, Glyph->V0);
+    GlyphBatchPushVertex(Quad + 1, x + width, y, Glyph->U1, Glyph->V0);
+    GlyphBatchPushVertex(Quad + 2, x, y + height, Glyph->U0, Glyph->V1);
+    GlyphBatchPushVertex(Quad + 3, x + width, y + height, Glyph->U1, Glyph->V1);
+    GlyphBatchPushVertex(Quad + 4, x + width, y, Glyph->U1, Glyph->V0);
+    GlyphBatchPushVertex(Quad + 5, x, y + height, Glyph->U0, Glyph->V1);
+
+    GlyphBatchCount++;
+}
+
+void GlyphBatchFlush(float red, float green, float blue, float alpha)
 {
+    if (GlyphBatchCount == 0) return;
+
     glUseProgram(GlyphProgram);
-    glBindVertexArray(GlyphVAO);
+    glBindVertexArray(GlyphBatchVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, GlyphBatchVBO);
 
-    GLuint GlyphLoc = glGetUniformLocation(GlyphProgram, "Glyph");
-    glUniform1i(GlyphLoc, 0);
+    glUniform1i(GlyphSamplerLoc, 0);
+    glUniform4f(GlyphColorLoc, red, green, blue, alpha);
 
-    GLuint ColorLoc = glGetUniformLocation(GlyphProgram, "Color");
-    glUniform4f(ColorLoc, red, green, blue, alpha);
+    // Creating the overlay binds its texture, so it goes before the atlas
+    uint8_t Overlay = TextOverlayActive();
+    if (Overlay) TextOverlayBegin();
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, GlyphTextures[letter - 1]);
+    glBindTexture(GL_TEXTURE_2D, GlyphAtlasTexture);
 
-    glViewport(x, y, width, height);
+    glViewport(0, 0, RESX, RESY);
+
+    // Batches bigger than the whole ring are drawn a ring at a time
+    for (int First = 0;First < GlyphBatchCount * 6;First += GLYPH_STREAM_VERTICES)
+    {
+        int Count = GlyphBatchCount * 6 - First;
+        if (Count > GLYPH_STREAM_VERTICES) Count = GLYPH_STREAM_VERTICES;
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+        if (GlyphStreamHead + Count > GLYPH_STREAM_VERTICES)
+        {
+            glBufferData(GL_ARRAY_BUFFER, GLYPH_STREAM_VERTICES * sizeof(GlyphVertex), 0, GL_STREAM_DRAW);
+            GlyphStreamHead = 0;
+        }
 
-    glViewport(0, 0, RESX, RESY);
+        void* Dst = glMapBufferRange(GL_ARRAY_BUFFER, GlyphStreamHead * sizeof(GlyphVertex), Count * sizeof(GlyphVertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        memcpy(Dst, GlyphBatch + First, Count * sizeof(GlyphVertex));
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+
+        glDrawArrays(GL_TRIANGLES, GlyphStreamHead, Count);
+        GlyphStreamHead += Count;
+    }
+
+    if (Overlay) TextOverlayEnd(GlyphBatchX0, GlyphBatchY0, GlyphBatchX1, GlyphBatchY1);
+
+    GlyphBatchCount = 0;
+}
+
+volatile void Renderer::DrawLetter(uint8_t letter, float x, float y, float width, float height, float red, float green, float blue, float alpha)
+{
+    GlyphBatchPush(letter, x, y, width, height);
+    GlyphBatchFlush(red, green, blue, alpha);
+}
+volatile void Renderer::DrawText(_String* text, float x, float y, float size, float red, float green, float blue, float alpha)
+{
+    float PenX = x;
+    float PenY = y;
+
+    for (int i = 0;i < text->Size;i++)
+    {
+        uint8_t C = StringGet(text, i);
+        switch (C)
+        {
+        case '\n':
+            PenX = x;
+            PenY += size * 1.25f;
+            break;
+        case '\t':
+            PenX += size * Glyphs['a'].Advance * 4;
+            break;
+        default:
+            if (C == 0 || C > GLYPH_COUNT) break;
+            GlyphBatchPush(C, PenX, PenY, size * Glyphs[C].Advance, size);
+            PenX += size * Glyphs[C].Advance;
+            break;
+        }
+    }
+
+    GlyphBatchFlush(red, green, blue, alpha);
+}
+volatile void Renderer::DrawTextCells(_String* text, float x, float y, float width, float height, float red, float green, float blue, float alpha)
+{
+    for (int i = 0;i < text->Size;i++)
+    {
+        uint8_t C = StringGet(text, i);
+        if (C != 0 && C <= GLYPH_COUNT) GlyphBatchPush(C, x, y, width, height);
+        x += width;
+    }
+
+    GlyphBatchFlush(red, green, blue, alpha);
 }
 volatile void Renderer::DrawCursor(float x, float y, float width, float height, float red, float green, float blue, float alpha)
 {
@@ -177,11 +1062,52 @@ volatile void Renderer::DrawCursor(float x, float y, float width, float height,
 
     glViewport(x, y, width, height);
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
     glViewport(0, 0, RESX, RESY);
 }
 volatile void Renderer::UpdateScreen()
 {
+    TextOverlayResolve();
     DisplayBuffer(glGetFramePtr());
-}
\ No newline at end of file
+    TextOverlayReset();
+
+    RenderScaleUpdate();
+}
+volatile void Renderer::AddDamage(int x, int y, int width, int height)
+{
+    glAddDamage(x, y, width, height);
+}
+volatile int Renderer::SetPresentBuffers(int Count)
+{
+    return PresentSetBuffers(Count);
+}
+volatile uint8_t Renderer::SetResolution(uint32_t Width, uint32_t Height)
+{
+    if (!DisplaySetMode(Width, Height)) return 0;
+
+    PresentModeChanged();
+    TextOverlayFree();
+    RenderScaleApply(RenderScale);
+    return 1;
+}
+volatile void Renderer::SetFrameBudget(float Milliseconds)
+{
+    if (Milliseconds <= 0.0f)
+    {
+        FrameBudgetCycles = 0;
+        if (RenderScale != RENDER_SCALE_MAX) RenderScaleApply(RENDER_SCALE_MAX);
+        return;
+    }
+
+    if (!FrameCyclesPerMs) FrameCyclesPerMs = FrameCalibrateTsc();
+
+    FrameBudgetCycles = (uint32_t)(Milliseconds * FrameCyclesPerMs);
+    FrameAverage = FrameBudgetCycles;
+    FrameLast = BenchTimestamp();
+    FrameHold = RENDER_SCALE_HOLD;
+}
+volatile void Renderer::SetNativeText(uint8_t Enable)
+{
+    TextNative = Enable;
+}
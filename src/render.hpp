@@ -2,6 +2,18 @@
 #define H_TOS_RENDER
 
 #include <stdint.h>
+#include "utils/string.hpp"
+
+// Location of one glyph inside the glyph atlas, plus how far the pen moves after it.
+// Advance is in units of the requested text size (the glyph cell height).
+typedef struct
+{
+    float U0;
+    float V0;
+    float U1;
+    float V1;
+    float Advance;
+} GlyphMetrics;
 
 class Renderer
 {
@@ -10,8 +22,27 @@ public:
     volatile void ClearScreen(float red, float green, float blue, float alpha);
     volatile void DrawBackground();
     volatile void DrawLetter(uint8_t letter, float x, float y, float width, float height, float red, float green, float blue, float alpha);
+    // Draws a whole string with a single draw call. size is the glyph cell height in pixels,
+    // '\n' moves to the next line and '\t' advances by four cells.
+    volatile void DrawText(_String* text, float x, float y, float size, float red, float green, float blue, float alpha);
+    // Same single draw call with every glyph stretched to one fixed width x height cell, like window titles
+    volatile void DrawTextCells(_String* text, float x, float y, float width, float height, float red, float green, float blue, float alpha);
     volatile void DrawCursor(float x, float y, float width, float height, float red, float green, float blue, float alpha);
+    // Makes the next UpdateScreen present a rectangle of the framebuffer (rows counted from the top)
+    // even if swgl didn't see it being written
+    volatile void AddDamage(int x, int y, int width, int height);
     volatile void UpdateScreen();
+    // 1 presents by copying to the visible screen, 2 or 3 flip between pages of video memory.
+    // Returns the count in use, which falls back to 1 where flipping isn't possible.
+    volatile int SetPresentBuffers(int Count);
+    // Switches the display and the framebuffer to Width x Height at 32bpp, 0 where only the boot mode works.
+    // The framebuffer contents are lost.
+    volatile uint8_t SetResolution(uint32_t Width, uint32_t Height);
+    // Renders at 50% to 100% of the display resolution in steps of 1/8, stepped every few frames to keep the
+    // frame time under Milliseconds, and upscales while presenting. 0 renders at the display resolution again.
+    volatile void SetFrameBudget(float Milliseconds);
+    // 1 keeps text at the display resolution while the rest is scaled. It's laid over everything else drawn.
+    volatile void SetNativeText(uint8_t Enable);
 };
 
-#endif // H_TOS_RENDER
\ No newline at end of file
+#endif // H_TOS_RENDER
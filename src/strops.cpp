@@ -0,0 +1,309 @@
+#include "strops.hpp"
+#include "memory.hpp"
+
+#include <emmintrin.h>
+
+#define CPUID_1_EDX_SSE2 (1 << 26)
+#define CPUID_7_EBX_ERMS (1 << 9)
+
+uint8_t StrOps_Erms;
+
+StrOps_CopyProc StrOps_CopyMedium = &StrOps_CopyRepMovsd;
+StrOps_CopyProc StrOps_CopyLarge = &StrOps_CopySse2;
+StrOps_CopyProc StrOps_CopyHuge = &StrOps_CopyStream;
+
+StrOps_SetProc StrOps_SetMedium = &StrOps_SetRepStosd;
+StrOps_SetProc StrOps_SetLarge = &StrOps_SetSse2;
+StrOps_SetProc StrOps_SetHuge = &StrOps_SetStream;
+
+static void StrOps_Cpuid(uint32_t Leaf, uint32_t* A, uint32_t* B, uint32_t* D)
+{
+    uint32_t C;
+    asm volatile ("cpuid" : "=a"(*A), "=b"(*B), "=c"(C), "=d"(*D) : "a"(Leaf), "c"(0));
+}
+
+void StrOps_Init()
+{
+    uint32_t MaxLeaf, A, B, D;
+    StrOps_Cpuid(0, &MaxLeaf, &B, &D);
+    StrOps_Cpuid(1, &A, &B, &D);
+    uint8_t Sse2 = (D & CPUID_1_EDX_SSE2) != 0;
+
+    StrOps_Erms = 0;
+    if (MaxLeaf >= 7)
+    {
+        StrOps_Cpuid(7, &A, &B, &D);
+        StrOps_Erms = (B & CPUID_7_EBX_ERMS) != 0;
+    }
+
+    StrOps_CopyMedium = StrOps_Erms ? &StrOps_CopyRepMovsb : &StrOps_CopyRepMovsd;
+    StrOps_SetMedium = StrOps_Erms ? &StrOps_SetRepStosb : &StrOps_SetRepStosd;
+
+    if (StrOps_Erms || !Sse2)
+    {
+        StrOps_CopyLarge = StrOps_CopyMedium;
+        StrOps_SetLarge = StrOps_SetMedium;
+    }
+
+    if (!Sse2)
+    {
+        StrOps_CopyHuge = StrOps_CopyMedium;
+        StrOps_SetHuge = StrOps_SetMedium;
+    }
+}
+
+static inline __attribute__((always_inline)) uint32_t StrOps_Load32(const uint8_t* Src)
+{
+    return *(const uint32_t*)Src;
+}
+
+static inline __attribute__((always_inline)) void StrOps_Store32(uint8_t* Dst, uint32_t Value)
+{
+    *(uint32_t*)Dst = Value;
+}
+
+// N <= STROPS_SMALL_MAX. Both ends are loaded before anything is stored, so overlapping is fine.
+static inline __attribute__((always_inline)) void StrOps_CopySmall(uint8_t* Dst, const uint8_t* Src, size_t N)
+{
+    if (N >= 8)
+    {
+        uint32_t A = StrOps_Load32(Src);
+        uint32_t B = StrOps_Load32(Src + 4);
+        uint32_t C = StrOps_Load32(Src + N - 8);
+        uint32_t D = StrOps_Load32(Src + N - 4);
+        StrOps_Store32(Dst, A);
+        StrOps_Store32(Dst + 4, B);
+        StrOps_Store32(Dst + N - 8, C);
+        StrOps_Store32(Dst + N - 4, D);
+    }
+    else if (N >= 4)
+    {
+        uint32_t A = StrOps_Load32(Src);
+        uint32_t B = StrOps_Load32(Src + N - 4);
+        StrOps_Store32(Dst, A);
+        StrOps_Store32(Dst + N - 4, B);
+    }
+    else if (N)
+    {
+        uint8_t A = Src[0];
+        uint8_t B = Src[N / 2];
+        uint8_t C = Src[N - 1];
+        Dst[0] = A;
+        Dst[N / 2] = B;
+        Dst[N - 1] = C;
+    }
+}
+
+static inline __attribute__((always_inline)) void StrOps_SetSmall(uint8_t* Dst, uint32_t Fill, size_t N)
+{
+    if (N >= 8)
+    {
+        StrOps_Store32(Dst, Fill);
+        StrOps_Store32(Dst + 4, Fill);
+        StrOps_Store32(Dst + N - 8, Fill);
+        StrOps_Store32(Dst + N - 4, Fill);
+    }
+    else if (N >= 4)
+    {
+        StrOps_Store32(Dst, Fill);
+        StrOps_Store32(Dst + N - 4, Fill);
+    }
+    else if (N)
+    {
+        Dst[0] = Fill;
+        Dst[N / 2] = Fill;
+        Dst[N - 1] = Fill;
+    }
+}
+
+void StrOps_CopyBytes(void* Dst, const void* Src, size_t N)
+{
+    uint8_t* Destination = (uint8_t*)Dst;
+    const uint8_t* Source = (const uint8_t*)Src;
+    while (N--) *Destination++ = *Source++;
+}
+
+// Copies forward one dword at a time, so it's also correct for overlaps with Dst below Src
+void StrOps_CopyRepMovsd(void* Dst, const void* Src, size_t N)
+{
+    size_t Dwords = N >> 2;
+    size_t Bytes = N & 3;
+    asm volatile ("rep movsl" : "+D"(Dst), "+S"(Src), "+c"(Dwords) :: "memory");
+    asm volatile ("rep movsb" : "+D"(Dst), "+S"(Src), "+c"(Bytes) :: "memory");
+}
+
+void StrOps_CopyRepMovsb(void* Dst, const void* Src, size_t N)
+{
+    asm volatile ("rep movsb" : "+D"(Dst), "+S"(Src), "+c"(N) :: "memory");
+}
+
+// The first 16 bytes are stored unaligned, the rest from the next 16 byte boundary of Dst on with aligned stores.
+// The last 16 bytes are stored unaligned again, loaded up front like the first.
+void StrOps_CopySse2(void* Dst, const void* Src, size_t N)
+{
+    uint8_t* D = (uint8_t*)Dst;
+    const uint8_t* S = (const uint8_t*)Src;
+    uint8_t* End = D + N;
+    __m128i Last = _mm_loadu_si128((const __m128i*)(S + N - 16));
+
+    _mm_storeu_si128((__m128i*)D, _mm_loadu_si128((const __m128i*)S));
+    size_t Head = 16 - ((uint32_t)D & 15);
+    D += Head;
+    S += Head;
+    N -= Head;
+
+    for (;N >= 64;N -= 64, D += 64, S += 64)
+    {
+        __m128i A = _mm_loadu_si128((const __m128i*)S);
+        __m128i B = _mm_loadu_si128((const __m128i*)(S + 16));
+        __m128i C = _mm_loadu_si128((const __m128i*)(S + 32));
+        __m128i E = _mm_loadu_si128((const __m128i*)(S + 48));
+        _mm_store_si128((__m128i*)D, A);
+        _mm_store_si128((__m128i*)(D + 16), B);
+        _mm_store_si128((__m128i*)(D + 32), C);
+        _mm_store_si128((__m128i*)(D + 48), E);
+    }
+
+    for (;N >= 16;N -= 16, D += 16, S += 16) _mm_store_si128((__m128i*)D, _mm_loadu_si128((const __m128i*)S));
+
+    _mm_storeu_si128((__m128i*)(End - 16), Last);
+}
+
+// Same as StrOps_CopySse2 with movntdq, the whole block goes to memory without being read into the cache first
+void StrOps_CopyStream(void* Dst, const void* Src, size_t N)
+{
+    uint8_t* D = (uint8_t*)Dst;
+    const uint8_t* S = (const uint8_t*)Src;
+    uint8_t* End = D + N;
+    __m128i Last = _mm_loadu_si128((const __m128i*)(S + N - 16));
+
+    _mm_storeu_si128((__m128i*)D, _mm_loadu_si128((const __m128i*)S));
+    size_t Head = 16 - ((uint32_t)D & 15);
+    D += Head;
+    S += Head;
+    N -= Head;
+
+    for (;N >= 64;N -= 64, D += 64, S += 64)
+    {
+        __m128i A = _mm_loadu_si128((const __m128i*)S);
+        __m128i B = _mm_loadu_si128((const __m128i*)(S + 16));
+        __m128i C = _mm_loadu_si128((const __m128i*)(S + 32));
+        __m128i E = _mm_loadu_si128((const __m128i*)(S + 48));
+        _mm_stream_si128((__m128i*)D, A);
+        _mm_stream_si128((__m128i*)(D + 16), B);
+        _mm_stream_si128((__m128i*)(D + 32), C);
+        _mm_stream_si128((__m128i*)(D + 48), E);
+    }
+
+    for (;N >= 16;N -= 16, D += 16, S += 16) _mm_stream_si128((__m128i*)D, _mm_loadu_si128((const __m128i*)S));
+
+    // Non-temporal stores are weakly ordered, they have to be visible before whatever the caller does next
+    _mm_sfence();
+
+    _mm_storeu_si128((__m128i*)(End - 16), Last);
+}
+
+void StrOps_SetBytes(void* Dst, uint8_t Val, size_t N)
+{
+    uint8_t* Destination = (uint8_t*)Dst;
+    while (N--) *Destination++ = Val;
+}
+
+void StrOps_SetRepStosd(void* Dst, uint8_t Val, size_t N)
+{
+    size_t Dwords = N >> 2;
+    size_t Bytes = N & 3;
+    asm volatile ("rep stosl" : "+D"(Dst), "+c"(Dwords) : "a"(Val * 0x01010101u) : "memory");
+    asm volatile ("rep stosb" : "+D"(Dst), "+c"(Bytes) : "a"((uint32_t)Val) : "memory");
+}
+
+void StrOps_SetRepStosb(void* Dst, uint8_t Val, size_t N)
+{
+    asm volatile ("rep stosb" : "+D"(Dst), "+c"(N) : "a"((uint32_t)Val) : "memory");
+}
+
+void StrOps_SetSse2(void* Dst, uint8_t Val, size_t N)
+{
+    uint8_t* D = (uint8_t*)Dst;
+    __m128i Fill = _mm_set1_epi8(Val);
+
+    _mm_storeu_si128((__m128i*)D, Fill);
+    _mm_storeu_si128((__m128i*)(D + N - 16), Fill);
+    size_t Head = 16 - ((uint32_t)D & 15);
+    D += Head;
+    N -= Head;
+
+    for (;N >= 64;N -= 64, D += 64)
+    {
+        _mm_store_si128((__m128i*)D, Fill);
+        _mm_store_si128((__m128i*)(D + 16), Fill);
+        _mm_store_si128((__m128i*)(D + 32), Fill);
+        _mm_store_si128((__m128i*)(D + 48), Fill);
+    }
+
+    for (;N >= 16;N -= 16, D += 16) _mm_store_si128((__m128i*)D, Fill);
+}
+
+void StrOps_SetStream(void* Dst, uint8_t Val, size_t N)
+{
+    uint8_t* D = (uint8_t*)Dst;
+    __m128i Fill = _mm_set1_epi8(Val);
+
+    _mm_storeu_si128((__m128i*)D, Fill);
+    _mm_storeu_si128((__m128i*)(D + N - 16), Fill);
+    size_t Head = 16 - ((uint32_t)D & 15);
+    D += Head;
+    N -= Head;
+
+    for (;N >= 64;N -= 64, D += 64)
+    {
+        _mm_stream_si128((__m128i*)D, Fill);
+        _mm_stream_si128((__m128i*)(D + 16), Fill);
+        _mm_stream_si128((__m128i*)(D + 32), Fill);
+        _mm_stream_si128((__m128i*)(D + 48), Fill);
+    }
+
+    for (;N >= 16;N -= 16, D += 16) _mm_stream_si128((__m128i*)D, Fill);
+
+    _mm_sfence();
+}
+
+// Walks from the end down in 16 byte blocks, each is loaded before the store that could overlap it.
+// For Dst above Src, the bytes left below are copied the same way one at a time.
+static void StrOps_CopyBackward(uint8_t* Dst, const uint8_t* Src, size_t N)
+{
+    for (;N >= 16;N -= 16) _mm_storeu_si128((__m128i*)(Dst + N - 16), _mm_loadu_si128((const __m128i*)(Src + N - 16)));
+    while (N--) Dst[N] = Src[N];
+}
+
+void memcpy(void* Destination_, const void* Source_, size_t N)
+{
+    if (N <= STROPS_SMALL_MAX) StrOps_CopySmall((uint8_t*)Destination_, (const uint8_t*)Source_, N);
+    else if (N <= STROPS_MEDIUM_MAX) StrOps_CopyMedium(Destination_, Source_, N);
+    else if (N < STROPS_STREAM_MIN) StrOps_CopyLarge(Destination_, Source_, N);
+    else StrOps_CopyHuge(Destination_, Source_, N);
+}
+
+void memset(void* Destination_, uint8_t Val, size_t N)
+{
+    if (N <= STROPS_SMALL_MAX) StrOps_SetSmall((uint8_t*)Destination_, Val * 0x01010101u, N);
+    else if (N <= STROPS_MEDIUM_MAX) StrOps_SetMedium(Destination_, Val, N);
+    else if (N < STROPS_STREAM_MIN) StrOps_SetLarge(Destination_, Val, N);
+    else StrOps_SetHuge(Destination_, Val, N);
+}
+
+void* memmove(void* dest, const void* src, size_t n)
+{
+    uint8_t* To = (uint8_t*)dest;
+    const uint8_t* From = (const uint8_t*)src;
+
+    if (To == From || n == 0) return dest;
+
+    if (n <= STROPS_SMALL_MAX) StrOps_CopySmall(To, From, n);
+    else if (To + n <= From || From + n <= To) memcpy(dest, src, n);
+    // The unaligned head of the SSE2 loops could overwrite source bytes still to be read
+    else if (To < From) StrOps_CopyRepMovsd(dest, src, n);
+    else StrOps_CopyBackward(To, From, n);
+
+    return dest;
+}
\ No newline at end of file
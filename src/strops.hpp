@@ -0,0 +1,41 @@
+#ifndef H_TOS_STROPS
+#define H_TOS_STROPS
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+* memcpy, memset and memmove pick an implementation by size. Up to STROPS_SMALL_MAX bytes are moved with a few
+* overlapping dword loads and stores, no loop and no call through a pointer, up to STROPS_MEDIUM_MAX with rep movsd/stosd, past that with an SSE2
+* loop storing aligned 16 byte blocks, and from STROPS_STREAM_MIN on with non-temporal stores that don't evict the
+* cache for data that wouldn't fit in it anyway. When the CPU has fast rep movsb/stosb (ERMSB) those replace both
+* rep movsd and the SSE2 loop.
+*/
+#define STROPS_SMALL_MAX 16
+#define STROPS_MEDIUM_MAX 512
+#define STROPS_STREAM_MIN (256 * 1024)
+
+typedef void (*StrOps_CopyProc)(void* Dst, const void* Src, size_t N);
+typedef void (*StrOps_SetProc)(void* Dst, uint8_t Val, size_t N);
+
+// 1 if the CPU reports enhanced rep movsb/stosb, valid after StrOps_Init
+extern uint8_t StrOps_Erms;
+
+// Picks the implementations from CPUID. Until it runs medium sizes use rep movsd/stosd, large ones the SSE2 loop
+// and huge ones non-temporal stores.
+void StrOps_Init();
+
+// Every strategy on its own, for MemBench. Dst and Src must not overlap, the SSE2 ones need N >= 16.
+void StrOps_CopyBytes(void* Dst, const void* Src, size_t N);
+void StrOps_CopyRepMovsd(void* Dst, const void* Src, size_t N);
+void StrOps_CopyRepMovsb(void* Dst, const void* Src, size_t N);
+void StrOps_CopySse2(void* Dst, const void* Src, size_t N);
+void StrOps_CopyStream(void* Dst, const void* Src, size_t N);
+
+void StrOps_SetBytes(void* Dst, uint8_t Val, size_t N);
+void StrOps_SetRepStosd(void* Dst, uint8_t Val, size_t N);
+void StrOps_SetRepStosb(void* Dst, uint8_t Val, size_t N);
+void StrOps_SetSse2(void* Dst, uint8_t Val, size_t N);
+void StrOps_SetStream(void* Dst, uint8_t Val, size_t N);
+
+#endif // H_TOS_STROPS
\ No newline at end of file
@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <cstddef>
+#include "arena.hpp"
+#include "../memory.hpp"
+
+#define ARENA_ALIGN 16
+// The header is padded so the first allocation of a block is aligned like the rest
+#define ARENA_HEADER ((sizeof(_ArenaBlock) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+static inline size_t ArenaRound(size_t Bytes)
+{
+	return (Bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static inline uint8_t* ArenaBlockData(_ArenaBlock* Block)
+{
+	return (uint8_t*)Block + ARENA_HEADER;
+}
+
+static _ArenaBlock* ArenaNewBlock(size_t Size)
+{
+	_ArenaBlock* Block = (_ArenaBlock*)aligned_alloc(ARENA_ALIGN, ARENA_HEADER + Size);
+	Block->Next = 0;
+	Block->Size = Size;
+	Block->Used = 0;
+	return Block;
+}
+
+_Arena* ArenaCreate(size_t BlockSize)
+{
+	_Arena* Arena = (_Arena*)malloc(sizeof(_Arena));
+	Arena->BlockSize = ArenaRound(BlockSize);
+	Arena->First = ArenaNewBlock(Arena->BlockSize);
+	Arena->Current = Arena->First;
+	return Arena;
+}
+
+void* ArenaAlloc(_Arena* Arena, size_t Bytes)
+{
+	Bytes = ArenaRound(Bytes);
+
+	_ArenaBlock* Block = Arena->Current;
+	while (Block->Used + Bytes > Block->Size)
+	{
+		// Blocks past the current one hold nothing live, the next one is reused if it is big enough
+		_ArenaBlock* Next = Block->Next;
+		if (!Next || Next->Size < Bytes)
+		{
+			Next = ArenaNewBlock(Bytes > Arena->BlockSize ? Bytes : Arena->BlockSize);
+			Next->Next = Block->Next;
+			Block->Next = Next;
+		}
+		Next->Used = 0;
+		Block = Next;
+	}
+
+	Arena->Current = Block;
+	void* Ptr = ArenaBlockData(Block) + Block->Used;
+	Block->Used += Bytes;
+	return Ptr;
+}
+
+void* ArenaRealloc(_Arena* Arena, void* Ptr, size_t OldBytes, size_t NewBytes)
+{
+	_ArenaBlock* Block = Arena->Current;
+	size_t OldRounded = ArenaRound(OldBytes);
+
+	if (Ptr && (uint8_t*)Ptr + OldRounded == ArenaBlockData(Block) + Block->Used)
+	{
+		size_t Start = Block->Used - OldRounded;
+		if (Start + ArenaRound(NewBytes) <= Block->Size)
+		{
+			Block->Used = Start + ArenaRound(NewBytes);
+			return Ptr;
+		}
+	}
+
+	void* NewPtr = ArenaAlloc(Arena, NewBytes);
+	if (Ptr) memcpy(NewPtr, Ptr, OldBytes < NewBytes ? OldBytes : NewBytes);
+	return NewPtr;
+}
+
+ArenaMark ArenaGetMark(_Arena* Arena)
+{
+	ArenaMark Mark = { Arena->Current, Arena->Current->Used };
+	return Mark;
+}
+
+void ArenaRelease(_Arena* Arena, ArenaMark Mark)
+{
+	Arena->Current = Mark.Block;
+	Arena->Current->Used = Mark.Used;
+}
+
+void ArenaReset(_Arena* Arena)
+{
+	Arena->Current = Arena->First;
+	Arena->Current->Used = 0;
+}
+
+void ArenaDestroy(_Arena* Arena)
+{
+	_ArenaBlock* Block = Arena->First;
+	while (Block)
+	{
+		_ArenaBlock* Next = Block->Next;
+		free(Block);
+		Block = Next;
+	}
+	free(Arena);
+}
\ No newline at end of file
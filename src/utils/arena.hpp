@@ -0,0 +1,46 @@
+#ifndef H_TOS_ARENA
+#define H_TOS_ARENA
+
+#include <cstddef>
+
+// Bump allocator for memory that dies all at once, a frame or a draw call.
+// Blocks are only ever taken from the heap while the arena grows, a reset keeps them
+// so the same work every frame allocates nothing after the first one.
+
+typedef struct _ArenaBlock
+{
+	struct _ArenaBlock* Next;
+	size_t Size; // Usable bytes after the header
+	size_t Used;
+} _ArenaBlock;
+
+typedef struct
+{
+	_ArenaBlock* First;
+	_ArenaBlock* Current;
+	size_t BlockSize;
+} _Arena;
+
+// Everything allocated after a mark is given back at once by ArenaRelease
+typedef struct
+{
+	_ArenaBlock* Block;
+	size_t Used;
+} ArenaMark;
+
+_Arena* ArenaCreate(size_t BlockSize);
+
+void* ArenaAlloc(_Arena* Arena, size_t Bytes); // 16 byte aligned
+
+// Grows Ptr in place when it was the last allocation, otherwise copies it. Ptr may be null.
+void* ArenaRealloc(_Arena* Arena, void* Ptr, size_t OldBytes, size_t NewBytes);
+
+ArenaMark ArenaGetMark(_Arena* Arena);
+
+void ArenaRelease(_Arena* Arena, ArenaMark Mark);
+
+void ArenaReset(_Arena* Arena);
+
+void ArenaDestroy(_Arena* Arena);
+
+#endif // H_TOS_ARENA
\ No newline at end of file
@@ -0,0 +1,21 @@
+#include <cstdint>
+#include "bench.hpp"
+
+void BenchAppendText(_String* _Str, const char* _Text)
+{
+	for (const char* C = _Text; *C; C++) StringPush(_Str, *C);
+}
+
+void BenchAppendNumber(_String* _Str, uint32_t _Value, int _Width)
+{
+	char Digits[10];
+	int Count = 0;
+	do
+	{
+		Digits[Count++] = '0' + _Value % 10;
+		_Value /= 10;
+	} while (_Value);
+
+	for (int i = Count; i < _Width; i++) StringPush(_Str, ' ');
+	while (Count > 0) StringPush(_Str, Digits[--Count]);
+}
\ No newline at end of file
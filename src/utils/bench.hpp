@@ -0,0 +1,21 @@
+#ifndef H_TOS_BENCH
+#define H_TOS_BENCH
+
+#include <cstdint>
+#include "string.hpp"
+
+// Helpers shared by the benchmark apps and anything else timing itself with the TSC
+
+static inline uint64_t BenchTimestamp()
+{
+	uint32_t Low, High;
+	asm volatile ("rdtsc" : "=a"(Low), "=d"(High));
+	return ((uint64_t)High << 32) | Low;
+}
+
+void BenchAppendText(_String* _Str, const char* _Text);
+
+// Decimal, right aligned in a column _Width wide. A _Width of 0 adds no padding.
+void BenchAppendNumber(_String* _Str, uint32_t _Value, int _Width);
+
+#endif // H_TOS_BENCH
\ No newline at end of file
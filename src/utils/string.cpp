@@ -10,6 +10,19 @@ _String* NewString()
 	String->Size = 0;
 	String->Data = (char*)malloc(String->Cap);
 	memset(String->Data, 0, String->Cap);
+	String->Arena = 0;
+	return String;
+}
+
+// Lives until the arena is reset, nothing of it is ever freed
+_String* NewArenaString(_Arena* _From)
+{
+	_String* String = (_String*)ArenaAlloc(_From, sizeof(_String));
+	String->Cap = 128;
+	String->Size = 0;
+	String->Data = (char*)ArenaAlloc(_From, String->Cap);
+	memset(String->Data, 0, String->Cap);
+	String->Arena = _From;
 	return String;
 }
 
@@ -23,12 +36,11 @@ void StringPush(_String* _Str, char c)
 	_Str->Data[_Str->Size++] = c;
 	if (_Str->Size >= _Str->Cap - 2)
 	{
+		int OldCap = _Str->Cap;
 		_Str->Cap += 128;
-		char* NewData = (char*)malloc(_Str->Cap);
-		memset(NewData, 0, _Str->Cap);
-		memcpy(NewData, _Str->Data, _Str->Size);
-		free(_Str->Data);
-		_Str->Data = NewData;
+		if (_Str->Arena) _Str->Data = (char*)ArenaRealloc(_Str->Arena, _Str->Data, OldCap, _Str->Cap);
+		else _Str->Data = (char*)realloc(_Str->Data, _Str->Cap);
+		memset(_Str->Data + _Str->Size, 0, _Str->Cap - _Str->Size);
 	}
 }
 
@@ -76,9 +88,9 @@ uint8_t StringEquals(_String* _A, const char* _B)
 
 void StringCopy(_String* _Dst, _String* _Src)
 {
-	free(_Dst->Data);
+	if (!_Dst->Arena) free(_Dst->Data);
 	_Dst->Cap = _Src->Cap;
 	_Dst->Size = _Src->Size;
-	_Dst->Data = (char*)malloc(_Dst->Cap);
+	_Dst->Data = _Dst->Arena ? (char*)ArenaAlloc(_Dst->Arena, _Dst->Cap) : (char*)malloc(_Dst->Cap);
 	memcpy(_Dst->Data, _Src->Data, _Src->Cap);
 }
\ No newline at end of file
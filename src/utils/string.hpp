@@ -1,15 +1,20 @@
 #ifndef H_TOS_STRING
 #define H_TOS_STRING
 
+#include "arena.hpp"
+
 typedef struct
 {
 	char* Data;
 	int Cap;
 	int Size;
+	_Arena* Arena; // Owner of the string and its data when not the heap
 } _String;
 
 _String* NewString();
 
+_String* NewArenaString(_Arena* _From);
+
 char StringGet(_String* _Str, int i);
 
 void StringPush(_String* _Str, char c);
@@ -5,23 +5,35 @@
 
 _Vector NewVector(size_t _ElemSize)
 {
-	_Vector* _Vec = (_Vector*)malloc(sizeof(_Vector));
-	_Vec->ElemSize = _ElemSize;
-	_Vec->Cap = 128;
-	_Vec->Size = 0;
-	_Vec->Data = malloc(_Vec->ElemSize * _Vec->Cap);
-	return *_Vec;
+	_Vector _Vec;
+	_Vec.ElemSize = _ElemSize;
+	_Vec.Cap = 128;
+	_Vec.Size = 0;
+	_Vec.Data = malloc(_Vec.ElemSize * _Vec.Cap);
+	_Vec.Arena = 0;
+	return _Vec;
+}
+
+// _Cap must stay above the largest size the vector reaches to never copy while growing
+_Vector NewArenaVector(_Arena* _From, size_t _ElemSize, int _Cap)
+{
+	_Vector _Vec;
+	_Vec.ElemSize = _ElemSize;
+	_Vec.Cap = _Cap > 0 ? _Cap : 1;
+	_Vec.Size = 0;
+	_Vec.Data = ArenaAlloc(_From, _Vec.ElemSize * _Vec.Cap);
+	_Vec.Arena = _From;
+	return _Vec;
 }
 
 void _VectorVerify(_Vector* _Vec)
 {
 	if (_Vec->Size >= _Vec->Cap)
 	{
+		int OldCap = _Vec->Cap;
 		_Vec->Cap += 128;
-		void* NewData = malloc(_Vec->ElemSize * _Vec->Cap);
-		memcpy(NewData, _Vec->Data, _Vec->ElemSize * _Vec->Size);
-		free(_Vec->Data);
-		_Vec->Data = NewData;
+		if (_Vec->Arena) _Vec->Data = ArenaRealloc(_Vec->Arena, _Vec->Data, _Vec->ElemSize * OldCap, _Vec->ElemSize * _Vec->Cap);
+		else _Vec->Data = realloc(_Vec->Data, _Vec->ElemSize * _Vec->Cap);
 	}
 }
 
@@ -51,18 +63,28 @@ void VectorWrite(_Vector* _Vec, void* _Data, int _Index)
 	memcpy((uint8_t*)_Vec->Data + _Vec->ElemSize * _Index, _Data, _Vec->ElemSize);
 }
 
+// Vectors are values, only their storage is on the heap. Arena storage goes with its arena.
 void VectorFree(_Vector* _Vec)
 {
-	free(_Vec->Data);
-	free(_Vec);
+	if (!_Vec->Arena) free(_Vec->Data);
+	_Vec->Data = 0;
 }
 
+// _Dest keeps where its storage comes from, an arena copy is only as large as the elements
 void VectorCopy(_Vector* _Dest, _Vector* _Src)
 {
-	free(_Dest->Data);
-	_Dest->Cap = _Src->Cap;
 	_Dest->Size = _Src->Size;
 	_Dest->ElemSize = _Src->ElemSize;
-	_Dest->Data = malloc(_Dest->Cap * _Dest->ElemSize);
+	if (_Dest->Arena)
+	{
+		_Dest->Cap = _Src->Size + 1;
+		_Dest->Data = ArenaAlloc(_Dest->Arena, _Dest->Cap * _Dest->ElemSize);
+	}
+	else
+	{
+		free(_Dest->Data);
+		_Dest->Cap = _Src->Cap;
+		_Dest->Data = malloc(_Dest->Cap * _Dest->ElemSize);
+	}
 	memcpy(_Dest->Data, _Src->Data, _Src->Size * _Src->ElemSize);
 }
\ No newline at end of file
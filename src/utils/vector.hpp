@@ -2,6 +2,7 @@
 #define H_TOS_VECTOR
 
 #include <cstddef>
+#include "arena.hpp"
 
 typedef struct
 {
@@ -9,10 +10,13 @@ typedef struct
 	int Cap;
 	int Size;
 	size_t ElemSize;
+	_Arena* Arena; // Storage owner when not the heap, freed with the arena
 } _Vector;
 
 _Vector NewVector(size_t _ElemSize);
 
+_Vector NewArenaVector(_Arena* _From, size_t _ElemSize, int _Cap);
+
 void _VectorVerify(_Vector* _Vec);
 
 void VectorPushBack(_Vector* _Vec, void* _Data);
@@ -83,12 +83,7 @@ void WindowSystem::Tick()
         glBindVertexArray(BorderVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
         
-        float StepX = 0.0f;
-
-        for (int j = 0;j < Window->Name->Size;j++)
-        {
-            Render.DrawLetter(StringGet(Window->Name, j), Window->X + (StepX += 20) - 10, Window->Y - 15, 20, 14, 1.0, 1.0, 1.0, 1.0);
-        }
+        Render.DrawTextCells(Window->Name, Window->X + 10, Window->Y - 15, 20, 14, 1.0, 1.0, 1.0, 1.0);
 
         glViewport(Window->X, Window->Y, Window->Width, Window->Height);
         (*Window->WinProc)(Window);
@@ -4,9 +4,14 @@
 #include <cstdint>
 #include "utils/string.hpp"
 #include "utils/vector.hpp"
+#include "utils/arena.hpp"
 
 #include "drivers/keyboard/keyboard.hpp"
 
+// Reset at the end of every frame by kmain, for whatever the windows and the apps
+// only need while drawing the current one
+extern _Arena* FrameArena;
+
 struct EventDescriptor
 {
     // 0b1? LMB clicked